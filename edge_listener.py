@@ -7,7 +7,11 @@ import matplotlib.animation as animation
 
 BROKER = "broker.hivemq.com"
 PORT = 1883
-TOPIC = "/esp8266/sensor"
+TOPIC = "/esp8266/sensor/batch"
+
+# Batched readings: { "N": n, "R": [ [t, Ipeak, Irms, Freq, THD, H1, H3, H5, H7, H9], ... ] }
+# t in AVR samples (1 kHz nominal), currents in 0.01 mA, Freq in 0.01 Hz, THD in 0.1 %
+SAMPLE_RATE_HZ = 1000.0
 
 WINDOW_DURATION = 60 
 
@@ -30,16 +34,17 @@ def on_connect(client, userdata, flags, rc):
 def on_message(client, userdata, msg):
     try:
         data = json.loads(msg.payload.decode())
-        t = time.time() - start_time
 
-        
-        timestamps.append(t)
-        Ipeak_vals.append(data.get("Ipeak", 0))
-        Irms_vals.append(data.get("Irms", 0))
-        Freq_vals.append(data.get("Freq", 0))
+        for row in data.get("R", []):
+            t = row[0] / SAMPLE_RATE_HZ
+            Ipeak, Irms, Freq = row[1] / 100.0, row[2] / 100.0, row[3] / 100.0
+
+            timestamps.append(t)
+            Ipeak_vals.append(Ipeak)
+            Irms_vals.append(Irms)
+            Freq_vals.append(Freq)
 
-       
-        print(f"[{t:.2f}s] Received: Ipeak={data.get('Ipeak', 0)}, Irms={data.get('Irms', 0)}, Freq={data.get('Freq', 0)}")
+        print(f"[{t:.2f}s] Received {data.get('N', 0)}: Ipeak={Ipeak}, Irms={Irms}, Freq={Freq}")
 
         while timestamps and (t - timestamps[0]) > WINDOW_DURATION:
             timestamps.popleft()
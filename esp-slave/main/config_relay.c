@@ -0,0 +1,111 @@
+#include "config_relay.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static const struct {
+    uint8_t key;
+    const char *name;
+} settings[] = {
+    { CFG_SAMPLE_RATE,     "SampleRate" },
+    { CFG_WINDOW,          "Window" },
+    { CFG_DECIMATION,      "Decimation" },
+    { CFG_SYNC,            "Sync" },
+    { CFG_BATCH,           "Batch" },
+    { CFG_VIEW,            "View" },
+    { CFG_WAVE_SOURCE,     "WaveSource" },
+    { CFG_WAVE_DELTA,      "WaveDelta" },
+    { CFG_CAPTURE_SOURCES, "CaptureSources" },
+    { CFG_CAPTURE_LEVEL,   "CaptureLevel" },
+    { CFG_CAPTURE_SLOPE,   "CaptureSlope" },
+    { CFG_CAPTURE_STEP,    "CaptureStep" },
+    { CFG_CAL_CENTER,      "CalCenter" },
+    { CFG_CAL_GAIN,        "CalGain" },
+    { CFG_CAL_PHASE,       "CalPhase" },
+    { CFG_CAL_ZERO,        "CalZero" },
+    { CFG_CAL_REFERENCE,   "CalReference" },
+    { CFG_CAL_SAVE,        "CalSave" },
+    { CFG_FIR_PROFILE,     "FirProfile" },
+    { CFG_FREQ_CYCLES,     "FreqCycles" },
+    { CFG_PUBLISH_FORMAT,  "PublishFormat" },
+    { CFG_PUBLISH_BATCH,   "PublishBatch" },
+    { CFG_PUBLISH_FLUSH,   "PublishFlushMs" },
+    { CFG_PUBLISH_QOS,     "PublishQos" },
+    { CFG_REPORT_PEAK,     "DeadbandPeak" },
+    { CFG_REPORT_RMS,      "DeadbandRms" },
+    { CFG_REPORT_FREQ,     "DeadbandFreq" },
+    { CFG_REPORT_MIN_MS,   "ReportMinMs" },
+    { CFG_REPORT_MAX_MS,   "ReportMaxMs" },
+};
+#define SETTINGS (sizeof(settings) / sizeof(settings[0]))
+_Static_assert(SETTINGS <= CONFIG_KEYS_MAX, "a message with every setting must fit CONFIG_KEYS_MAX");
+
+// Flat objects of integer members only, so a key search is enough
+int config_parse(const char *json, int len, uint8_t *keys, uint16_t *values, int max)
+{
+    char pattern[24];
+    int n = 0;
+
+    // every setting in one message runs past 500 bytes: copied to the heap
+    char *text = malloc(len + 1);
+    if (!text) return 0;
+    memcpy(text, json, len);
+    text[len] = '\0';
+
+    for (int i = 0; i < (int)SETTINGS && n < max; i++) {
+        snprintf(pattern, sizeof(pattern), "\"%s\"", settings[i].name);
+        const char *p = strstr(text, pattern);
+        if (!p) continue;
+
+        p += strlen(pattern);
+        while (*p == ' ' || *p == '\t') p++;
+        if (*p++ != ':') continue;
+
+        char *end;
+        long v = strtol(p, &end, 0);
+        if (end == p || v < 0 || v > 0xFFFF) continue;
+
+        keys[n] = settings[i].key;
+        values[n] = v;
+        n++;
+    }
+    free(text);
+    return n;
+}
+
+int config_status_json(const uint8_t *d, uint8_t len, char *buf, int size)
+{
+    if (len < 2 || len < 2 + 3 * d[1]) return -1;
+
+    uint8_t n = d[1];
+    int out = snprintf(buf, size, "{ \"Seq\": %u, \"Applied\": {", d[0]);
+    int rejected = 0, first = 1;
+
+    for (int i = 0; i < n && out < size; i++) {
+        const uint8_t *e = d + 2 + 3 * i;
+        if (e[0] & CFG_REJECTED) {
+            rejected++;
+            continue;
+        }
+        const char *name = NULL;
+        for (int k = 0; k < (int)SETTINGS; k++)
+            if (settings[k].key == e[0]) name = settings[k].name;
+        if (name)
+            out += snprintf(buf + out, size - out, "%s \"%s\": %u", first ? "" : ",", name, (e[1] << 8) | e[2]);
+        else
+            out += snprintf(buf + out, size - out, "%s \"%u\": %u", first ? "" : ",", e[0], (e[1] << 8) | e[2]);
+        first = 0;
+    }
+    if (out < size)
+        out += snprintf(buf + out, size - out, " }, \"Rejected\": [");
+    first = 1;
+    for (int i = 0; i < n && rejected && out < size; i++) {
+        const uint8_t *e = d + 2 + 3 * i;
+        if (!(e[0] & CFG_REJECTED)) continue;
+        out += snprintf(buf + out, size - out, "%s %u", first ? "" : ",", e[0] & ~CFG_REJECTED);
+        first = 0;
+    }
+    if (out < size)
+        out += snprintf(buf + out, size - out, " ] }");
+    return out < size ? out : -1;
+}
@@ -0,0 +1,53 @@
+#ifndef CONFIG_RELAY_H
+#define CONFIG_RELAY_H
+
+#include <stdint.h>
+
+/* Runtime settings of the ATmega328P, sent as JSON on the config topic,
+   e.g. { "SampleRate": 500, "Window": 50, "Sync": 0 }, and relayed over the
+   SPI downlink as [key, value] pairs. Keys match the AVR's config.h. */
+#define CFG_SAMPLE_RATE     0x01   // Hz, when not locked to the mains
+#define CFG_WINDOW          0x02   // samples per window, when not locked
+#define CFG_DECIMATION      0x03   // log2 oversampling
+#define CFG_SYNC            0x04   // mains-synchronous window on / off
+#define CFG_BATCH           0x05   // windows per SPI frame
+#define CFG_VIEW            0x06   // display view
+#define CFG_WAVE_SOURCE     0x07
+#define CFG_WAVE_DELTA      0x08
+#define CFG_CAPTURE_SOURCES 0x09
+#define CFG_CAPTURE_LEVEL   0x0A
+#define CFG_CAPTURE_SLOPE   0x0B
+#define CFG_CAPTURE_STEP    0x0C
+#define CFG_CAL_CENTER      0x0D   // coarse ADC offset, LSB
+#define CFG_CAL_GAIN        0x0E   // Q14, 16384 = 1.0
+#define CFG_CAL_PHASE       0x0F   // input delay, 1/256 sample
+#define CFG_CAL_ZERO        0x10   // with no current: fold the DC estimate into the center
+#define CFG_CAL_REFERENCE   0x11   // with a known current, 0.01 mA: set the gain from it
+#define CFG_CAL_SAVE        0x12   // 1 stores the calibration in EEPROM, 0 reloads it
+#define CFG_FIR_PROFILE     0x13   // filter profile, src/fir_coeffs.h on the AVR
+#define CFG_FREQ_CYCLES     0x14   // mains periods averaged per frequency estimate
+#define CFG_REJECTED        0x80   // set by the AVR on keys it does not know
+
+/* Publisher settings on the same topic, applied by the ESP itself and
+   never relayed (mqtt_publish.h) */
+#define CFG_PUBLISH_FORMAT  0x40   // BATCH_FORMAT_*
+#define CFG_PUBLISH_BATCH   0x41   // readings per message, 1 .. BATCH_MAX
+#define CFG_PUBLISH_FLUSH   0x42   // ms before a partial batch goes out
+#define CFG_PUBLISH_QOS     0x43
+#define CFG_REPORT_PEAK     0x44   // deadband, 0.01 mA
+#define CFG_REPORT_RMS      0x45   // deadband, 0.01 mA
+#define CFG_REPORT_FREQ     0x46   // deadband, 0.01 Hz
+#define CFG_REPORT_MIN_MS   0x47   // least time between rows
+#define CFG_REPORT_MAX_MS   0x48   // heartbeat, at least the minimum
+
+#define CONFIG_KEYS_MAX     32     // room for every setting in one message
+
+/* Settings found in a JSON object; returns how many were stored */
+int config_parse(const char *json, int len, uint8_t *keys, uint16_t *values, int max);
+
+/* SPI_REC_CONFIG payload as JSON status,
+   { "Seq": 5, "Applied": { "SampleRate": 500, ... }, "Rejected": [ 13 ] };
+   returns the length, or -1 if the record is malformed */
+int config_status_json(const uint8_t *d, uint8_t len, char *buf, int size);
+
+#endif // CONFIG_RELAY_H
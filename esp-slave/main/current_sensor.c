@@ -12,21 +12,209 @@
 #include "driver/spi.h"
 #include "driver/hspi_logic_layer.h"
 #include "mqtt_publish.h"
+#include "spi_frame.h"
+#include "record_queue.h"
+#include "spool.h"
+#include "config_relay.h"
+#include <stdbool.h>
+#include <string.h>
 
 #define BROKER "mqtt://broker.hivemq.com"
 #define SSID "mutu_test"
 #define PASSWORD "12a12@12"
 
 #define SPI_SLAVE_HANDSHAKE_GPIO 2
-#define SPI_READ_BUFFER_MAX_SIZE 12   // 6 bytes for 3 x uint16_t
+#define SPI_READ_BUFFER_MAX_SIZE 32   // one HSPI slave buffer
+
+#define CAPTURE_CHUNK        12
+#define CAPTURE_MAX_CHUNKS   16
+
+#define WAVE_RECORD_MAX      32     // samples in one SPI_REC_WAVE record
+#define WAVE_PUBLISH         128    // samples per /esp8266/sensor/wave message
+
+// Publish readings (by exception and batched, see mqtt_publish.h), or only the 1 s / 10 s / 60 s summaries
+#define PUBLISH_READINGS 1
+
+// Receive task above the MQTT client, publisher below it
+#define RX_TASK_PRIORITY        6
+#define PUBLISH_TASK_PRIORITY   4
+#define LINK_STATS_MS           10000   // link statistics log and publish period
+#define PUBLISH_POLL_MS         100     // publisher wake-up for batch flush deadlines
+#define CONFIG_WRITE_MS         500     // wait for room in the HSPI read buffer
 
 static const char *TAG = "SPI_SLAVE";
 
+// Receive task -> publisher task
+static rec_queue_t rx_queue;
+static spi_parser_t parser;
+static TaskHandle_t publisher = NULL;
+
 // Variables to store received values
 volatile uint16_t Ipeak = 0;
 volatile uint16_t Irms  = 0;
 volatile uint16_t Freq  = 0;
 
+// Transient snapshot being reassembled from SPI_SUB_CAPTURE chunks
+static int16_t capture_samples[CAPTURE_MAX_CHUNKS * CAPTURE_CHUNK];
+static uint32_t capture_received = 0;   // bit per chunk
+static int capture_event = -1;
+
+static void capture_chunk(const uint8_t *d)
+{
+    uint8_t event = d[0], chunk = d[1], chunks = d[2], source = d[3], pre = d[4];
+
+    if (chunks == 0 || chunks > CAPTURE_MAX_CHUNKS || chunk >= chunks) return;
+    if (event != capture_event) {
+        capture_event = event;
+        capture_received = 0;
+    }
+
+    for (int i = 0; i < CAPTURE_CHUNK; i++)
+        capture_samples[chunk * CAPTURE_CHUNK + i] = (int16_t)((d[5 + 2 * i] << 8) | d[6 + 2 * i]);
+    capture_received |= 1UL << chunk;
+
+    if (capture_received == (1UL << chunks) - 1) {
+        ESP_LOGI(TAG, "Capture %u complete, source 0x%02x", event, source);
+        mqtt_publish_capture(event, source, pre, capture_samples, chunks * CAPTURE_CHUNK);
+        capture_received = 0;
+    }
+}
+
+// Waveform stream, collected from SPI_REC_WAVE records into larger messages
+static int16_t wave_samples[WAVE_PUBLISH];
+static int wave_count = 0;
+static uint16_t wave_first, wave_next;
+static uint8_t wave_source;
+
+static void wave_record(const uint8_t *d, uint8_t len)
+{
+    int16_t s[WAVE_RECORD_MAX];
+    int n = spi_wave_decode(d, len, s, WAVE_RECORD_MAX);
+    if (n <= 0) return;
+
+    uint8_t source = d[0];
+    uint16_t first = (d[2] << 8) | d[3];
+
+    // a gap or a new tap point ends the current message
+    if (wave_count && (first != wave_next || source != wave_source || wave_count + n > WAVE_PUBLISH)) {
+        mqtt_publish_wave(wave_source, wave_first, wave_samples, wave_count);
+        wave_count = 0;
+    }
+    if (!wave_count) {
+        wave_first = first;
+        wave_source = source;
+    }
+
+    memcpy(&wave_samples[wave_count], s, n * sizeof(int16_t));
+    wave_count += n;
+    wave_next = first + n;
+
+    if (wave_count == WAVE_PUBLISH) {
+        mqtt_publish_wave(wave_source, wave_first, wave_samples, wave_count);
+        wave_count = 0;
+    }
+}
+
+// Settings from the config topic (MQTT task): one command packet per
+// SPI_CMD_MAX settings, queued for the master's next read slots
+static uint8_t config_seq;
+
+// A publisher setting, applied here: false for the AVR's keys. The value
+// becomes the one in effect, like the AVR's echo.
+static bool config_local(uint8_t key, uint16_t *value)
+{
+    mqtt_batch_config_t batch = *mqtt_batch_config();
+    mqtt_report_config_t report = *mqtt_report_config();
+    uint16_t v = *value;
+
+    switch (key) {
+    case CFG_PUBLISH_FORMAT:
+        v = batch.format = v ? BATCH_FORMAT_BINARY : BATCH_FORMAT_JSON;
+        break;
+    case CFG_PUBLISH_BATCH:
+        v = batch.size = v < 1 ? 1 : v > BATCH_MAX ? BATCH_MAX : v;
+        break;
+    case CFG_PUBLISH_FLUSH:
+        batch.flush_ms = v;
+        break;
+    case CFG_PUBLISH_QOS:
+        v = batch.qos = v > 2 ? 2 : v;
+        break;
+    case CFG_REPORT_PEAK:
+        report.deadband_peak = v;
+        break;
+    case CFG_REPORT_RMS:
+        report.deadband_rms = v;
+        break;
+    case CFG_REPORT_FREQ:
+        report.deadband_freq = v;
+        break;
+    case CFG_REPORT_MIN_MS:
+        report.min_ms = v;
+        break;
+    case CFG_REPORT_MAX_MS:
+        if (v < report.min_ms) v = report.min_ms;
+        report.max_ms = v;
+        break;
+    default:
+        return false;
+    }
+    if (key >= CFG_REPORT_PEAK)     // the report keys follow the batch keys
+        mqtt_report_configure(&report);
+    else
+        mqtt_batch_configure(&batch);
+    *value = v;
+    return true;
+}
+
+static void config_received(const char *data, int len)
+{
+    uint8_t keys[CONFIG_KEYS_MAX];
+    uint16_t values[CONFIG_KEYS_MAX];
+    uint8_t packet[SPI_CMD_BYTES];
+
+    int n = config_parse(data, len, keys, values, CONFIG_KEYS_MAX);
+    if (!n) {
+        ESP_LOGW(TAG, "Config message without known settings: %.*s", len, data);
+        return;
+    }
+
+    // publisher settings take effect at once and get a status of their own,
+    // laid out like the AVR's SPI_REC_CONFIG record; the rest is relayed
+    uint8_t applied[2 + 3 * CONFIG_KEYS_MAX];
+    int local = 0, relay = 0;
+    for (int i = 0; i < n; i++) {
+        if (config_local(keys[i], &values[i])) {
+            applied[2 + 3 * local] = keys[i];
+            applied[3 + 3 * local] = values[i] >> 8;
+            applied[4 + 3 * local] = values[i];
+            local++;
+        } else {
+            keys[relay] = keys[i];
+            values[relay] = values[i];
+            relay++;
+        }
+    }
+    if (local) {
+        char status[384];
+        if (++config_seq == 0) config_seq = 1;
+        applied[0] = config_seq;
+        applied[1] = local;
+        int m = config_status_json(applied, 2 + 3 * local, status, sizeof(status));
+        if (m > 0) mqtt_publish_config_status(status, m);
+    }
+    n = relay;
+
+    for (int i = 0; i < n; i += SPI_CMD_MAX) {
+        if (++config_seq == 0) config_seq = 1;
+        spi_command_build(packet, config_seq, keys + i, values + i, n - i);
+        if (hspi_slave_logic_write_data(packet, SPI_CMD_BYTES, pdMS_TO_TICKS(CONFIG_WRITE_MS)) < SPI_CMD_BYTES)
+            ESP_LOGW(TAG, "Config packet %u not queued for the master", config_seq);
+        else
+            ESP_LOGI(TAG, "Config packet %u: %d settings", config_seq, n - i < SPI_CMD_MAX ? n - i : SPI_CMD_MAX);
+    }
+}
+
 // SPI initialization
 void comm_spi_init(void)
 {
@@ -47,36 +235,189 @@ void comm_spi_init(void)
 
 
 
+#if PUBLISH_READINGS
+// A window's reading waits for its SPI_REC_CHANNELS record, which follows
+// the SPI_REC_CURRENT record in the same frame in a multi-channel build.
+// The receive task commits a frame record by record, so a pass of the
+// publisher may end between the two: a reading is only given up on once a
+// whole pass has gone by without its channels, or at the next window.
+static mqtt_reading_t held;
+static bool holding = false;
+static bool channels_seen = false;  // multi-channel AVR build
+static uint8_t pass, held_pass;
+
+static void reading_flush(void)
+{
+    if (!holding) return;
+    mqtt_report_add(&held);
+    holding = false;
+}
+#endif
+
+// Publisher side: one record of a received frame, 16-bit values MSB first
+static void publish_record(const rec_entry_t *e)
+{
+    uint8_t type = e->type, len = e->len;
+    const uint8_t *d = e->data;
+
+    if (type == SPI_REC_CURRENT && len >= 7 + 2 + 2 * HARMONICS) {
+        Ipeak = (d[1] << 8) | d[2];
+        Irms  = (d[3] << 8) | d[4];
+        Freq  = (d[5] << 8) | d[6];
+
+        ESP_LOGD(TAG, "Ipeak: %u, Irms: %u, Freq: %u", Ipeak, Irms, Freq);
+#if PUBLISH_READINGS
+        reading_flush();
+        held = (mqtt_reading_t){
+            .stamp = e->stamp,
+            .peak = Ipeak,
+            .rms = Irms,
+            .freq = Freq,
+            .thd = (d[7] << 8) | d[8],
+        };
+        for (int k = 0; k < HARMONICS; k++)
+            held.harm[k] = (d[9 + 2 * k] << 8) | d[10 + 2 * k];
+        holding = true;
+        held_pass = pass;
+#endif
+    } else if (type == SPI_REC_CHANNELS && len >= 1 && d[0] <= CHANNELS_MAX && len >= 1 + 4 * d[0]) {
+#if PUBLISH_READINGS
+        channels_seen = true;
+        if (holding && held.stamp == e->stamp) {
+            held.channels = d[0];
+            for (int c = 0; c < d[0]; c++) {
+                held.ch_peak[c] = (d[1 + 4 * c] << 8) | d[2 + 4 * c];
+                held.ch_rms[c]  = (d[3 + 4 * c] << 8) | d[4 + 4 * c];
+            }
+            reading_flush();
+        }
+#endif
+    } else if (type == SPI_REC_AGGREGATE && len >= 9) {
+        uint8_t level     = d[0];
+        uint16_t rms_min  = (d[1] << 8) | d[2];
+        uint16_t rms_max  = (d[3] << 8) | d[4];
+        uint16_t rms_mean = (d[5] << 8) | d[6];
+        uint16_t peak     = (d[7] << 8) | d[8];
+
+        ESP_LOGI(TAG, "Summary %u: Irms %u..%u mean %u, peak hold %u",
+                 level, rms_min, rms_max, rms_mean, peak);
+        mqtt_publish_summary(level, rms_min, rms_max, rms_mean, peak);
+    } else if (type == SPI_REC_CAPTURE && len >= 5 + 2 * CAPTURE_CHUNK) {
+        capture_chunk(d);
+    } else if (type == SPI_REC_WAVE) {
+        wave_record(d, len);
+    } else if (type == SPI_REC_CONFIG) {
+        char status[256];
+        int n = config_status_json(d, len, status, sizeof(status));
+        if (n > 0) mqtt_publish_config_status(status, n);
+    }
+}
+
+static void publish_link_stats(void)
+{
+    mqtt_link_stats_t st = {
+        .frames = parser.frames,
+        .lost = parser.lost,
+        .crc_errors = parser.crc_errors,
+        .depth = rec_queue_depth(&rx_queue),
+        .high_water = rx_queue.high_water,
+        .drops = rx_queue.drops,
+    };
+    spool_stats_t sp;
+    spool_stats(&sp);
+    st.spooled = sp.ram_msgs + sp.flash_msgs;
+    st.spool_drops = sp.dropped;
+
+    ESP_LOGI(TAG, "SPI link: %u frames, %u lost, %u CRC errors; queue %u (max %u), %u dropped; "
+             "spool %u in RAM, %u in flash, %u dropped",
+             st.frames, st.lost, st.crc_errors, st.depth, st.high_water, st.drops,
+             sp.ram_msgs, sp.flash_msgs, sp.dropped);
+    mqtt_publish_link(&st);
+}
+
+// Drains the record queue, so a slow broker or log UART never holds up reception
+static void publisher_task(void *arg)
+{
+    TickType_t last_stats = xTaskGetTickCount();
+
+    for (;;)
+    {
+        ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(PUBLISH_POLL_MS));
+
+        rec_entry_t *e;
+        while ((e = rec_queue_peek(&rx_queue)) != NULL) {
+            publish_record(e);
+            rec_queue_release(&rx_queue);
+        }
+#if PUBLISH_READINGS
+        if (!channels_seen || held_pass != pass)
+            reading_flush();
+        pass++;
+#endif
+        mqtt_batch_poll();
+        mqtt_spool_poll();
+
+        if (xTaskGetTickCount() - last_stats >= pdMS_TO_TICKS(LINK_STATS_MS)) {
+            last_stats = xTaskGetTickCount();
+            publish_link_stats();
+        }
+    }
+}
+
+// Blocks until the master has written an HSPI buffer, parses the stream and
+// queues the records; nothing here waits on the network or the log
 void IRAM_ATTR spi_slave_read_master_task(void *arg)
 {
     uint8_t read_data[SPI_READ_BUFFER_MAX_SIZE];
+    spi_frame_t frame;
 
     for (;;)
     {
-        taskYIELD();
+        int read_len = hspi_slave_logic_read_data(read_data, SPI_READ_BUFFER_MAX_SIZE, portMAX_DELAY);
+        int queued = 0;
 
-        int read_len = hspi_slave_logic_read_data(read_data, SPI_READ_BUFFER_MAX_SIZE, 1);
+        for (int i = 0; i < read_len; i++) {
+            if (!spi_parser_feed(&parser, read_data[i], &frame)) continue;
 
-        if (read_len >= 7) { // 1 command + 6 bytes
-    if (read_data[0] != 0x02) continue; // verify command
+            // the frame stamp ends the first window, each further one adds its count
+            uint32_t stamp = frame.stamp;
+            int windows = 0;
+            uint8_t offset = 0, type, len;
+            const uint8_t *d;
+            while (spi_frame_record(&frame, &offset, &type, &d, &len)) {
+                if (type == SPI_REC_CURRENT && len >= 1 && windows++)
+                    stamp += d[0];
+                if (len > REC_DATA_MAX) continue;
 
-    Ipeak = (read_data[1] << 8) | read_data[2];
-    Irms  = (read_data[3] << 8) | read_data[4];
-    Freq  = (read_data[5] << 8) | read_data[6];
+                rec_entry_t *e = rec_queue_claim(&rx_queue);
+                if (!e) continue;
+                e->stamp = stamp;
+                e->type = type;
+                e->len = len;
+                memcpy(e->data, d, len);
+                rec_queue_commit(&rx_queue);
+                queued++;
+            }
+        }
 
-    ESP_LOGI(TAG, "Ipeak: %u, Irms: %u, Freq: %u", Ipeak, Irms, Freq);
-    mqtt_publish_values(Ipeak, Irms, Freq);
+        if (queued && publisher) xTaskNotifyGive(publisher);
+    }
 }
-    }}
-
 
 void app_main(void)
 {
     // Initialize SPI slave
     comm_spi_init();
 
+    // a fresh sequence after a reset, so the master does not take a new packet for a repeat
+    config_seq = esp_random();
+    mqtt_set_config_handler(config_received);
     mqtt_init(SSID, PASSWORD, BROKER);
 
-    xTaskCreate(spi_slave_read_master_task, "spi_slave_task", 2048, NULL, 5, NULL);
+    rec_queue_init(&rx_queue);
+    spi_parser_init(&parser);
+
+    xTaskCreate(publisher_task, "publisher_task", 3072, NULL, PUBLISH_TASK_PRIORITY, &publisher);
+    xTaskCreate(spi_slave_read_master_task, "spi_slave_task", 2048, NULL, RX_TASK_PRIORITY, NULL);
     ESP_LOGI(TAG, "SPI Slave ready to  publish to MQTT...");
 }
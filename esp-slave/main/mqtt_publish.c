@@ -1,4 +1,5 @@
 #include "mqtt_publish.h"
+#include "spool.h"
 #include "esp_system.h"
 #include "esp_log.h"
 #include "nvs_flash.h"
@@ -9,11 +10,23 @@
 #include "esp_wifi.h"
 #include "mqtt_client.h"
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 
 static const char *TAG = "MQTT";
 static esp_mqtt_client_handle_t client = NULL;
 static bool mqtt_connected = false;
+static mqtt_config_handler_t config_handler = NULL;
+
+// Topics that survive an outage, by spool topic id
+enum { TOPIC_BATCH, TOPIC_BATCH_BIN, TOPIC_SUMMARY, TOPIC_EVENT, TOPIC_CONFIG_STATUS, TOPIC_COUNT };
+static const char *const topics[TOPIC_COUNT] = {
+    "/esp8266/sensor/batch",
+    "/esp8266/sensor/batch/bin",
+    "/esp8266/sensor/summary",
+    "/esp8266/sensor/event",
+    CONFIG_STATUS_TOPIC,
+};
 
 // Event group for Wi-Fi connection
 static EventGroupHandle_t wifi_event_group;
@@ -52,6 +65,7 @@ static esp_err_t mqtt_event_handler_cb(void *handler_args, esp_event_base_t base
         case MQTT_EVENT_CONNECTED:
             ESP_LOGI(TAG, "MQTT connected");
             mqtt_connected = true;
+            esp_mqtt_client_subscribe(event->client, CONFIG_TOPIC, 1);
             break;
         case MQTT_EVENT_DISCONNECTED:
             ESP_LOGI(TAG, "MQTT disconnected");
@@ -60,6 +74,13 @@ static esp_err_t mqtt_event_handler_cb(void *handler_args, esp_event_base_t base
         case MQTT_EVENT_PUBLISHED:
             ESP_LOGI(TAG, "Message published");
             break;
+        case MQTT_EVENT_DATA:
+            // settings are small: fragmented messages are not reassembled
+            if (config_handler && event->topic_len == strlen(CONFIG_TOPIC)
+                && !memcmp(event->topic, CONFIG_TOPIC, event->topic_len)
+                && event->current_data_offset == 0 && event->data_len == event->total_data_len)
+                config_handler(event->data, event->data_len);
+            break;
         default:
             break;
     }
@@ -89,6 +110,9 @@ void mqtt_init(const char* ssid, const char* password, const char* mqtt_uri)
     }
     ESP_ERROR_CHECK(ret);
 
+    // Recover messages spooled before the last reset
+    spool_init();
+
     // Initialize TCP/IP stack
     tcpip_adapter_init();
     ESP_ERROR_CHECK(esp_event_loop_init(wifi_event_handler, NULL));
@@ -118,26 +142,394 @@ void mqtt_init(const char* ssid, const char* password, const char* mqtt_uri)
 
     if (bits & WIFI_CONNECTED_BIT) {
         ESP_LOGI(TAG, "Wi-Fi connected successfully, starting MQTT...");
-        // Start MQTT only after Wi-Fi is connected
-        mqtt_app_start(mqtt_uri);
     } else {
-        ESP_LOGE(TAG, "Failed to connect to Wi-Fi, MQTT not started");
+        ESP_LOGW(TAG, "Wi-Fi not connected yet, spooling until MQTT comes up");
     }
+    // The client reconnects on its own; until then messages go to the spool
+    mqtt_app_start(mqtt_uri);
 }
 
-// Publish JSON values 
-void mqtt_publish_values(uint16_t Ipeak, uint16_t Irms, uint16_t Freq)
+// Publish now if the link is up and nothing older is waiting, spool otherwise
+static void mqtt_send(uint8_t topic, const char *data, int len, int qos)
 {
+    if (mqtt_connected && client && spool_empty()
+        && esp_mqtt_client_publish(client, topics[topic], data, len, qos, 0) >= 0)
+        return;
+
+    if (spool_put(topic, qos, data, len) < 0)
+        ESP_LOGW(TAG, "%d byte message too large to spool, dropped", len);
+}
+
+void mqtt_spool_poll(void)
+{
+    static char buf[SPOOL_MSG_MAX];
+    static TickType_t last_sync;
+
     if (!mqtt_connected || !client) {
-        ESP_LOGW(TAG, "MQTT not connected, skipping publish");
+        // keep the backlog in flash in case the outage ends in a reset
+        if (!spool_empty() && xTaskGetTickCount() - last_sync >= pdMS_TO_TICKS(SPOOL_SYNC_MS)) {
+            last_sync = xTaskGetTickCount();
+            spool_sync();
+        }
         return;
     }
 
-    char payload[128];
-    snprintf(payload, sizeof(payload),
-             "{ \"Ipeak\": %f, \"Irms\": %f, \"Freq\": %f }",
-             Ipeak/100.0f, Irms/100.0f, Freq/100.0f);
+    for (int n = 0; n < SPOOL_REPLAY_PER_POLL; n++) {
+        uint8_t topic, qos;
+        int len = spool_peek(&topic, &qos, buf, sizeof(buf));
+        if (len < 0) break;
+        if (topic < TOPIC_COUNT
+            && esp_mqtt_client_publish(client, topics[topic], buf, len, qos, 0) < 0)
+            break;
+        spool_pop();
+    }
+}
 
-    esp_mqtt_client_publish(client, "/esp8266/sensor", payload, 0, 1, 0);
+// Publish JSON summary, one topic for all levels
+void mqtt_publish_summary(uint8_t level, uint16_t rms_min, uint16_t rms_max,
+                          uint16_t rms_mean, uint16_t peak_hold)
+{
+    static const uint8_t span_s[] = { 1, 10, 60 };
+
+    if (level >= sizeof(span_s)) return;
+
+    // 0.01 mA values printed as mA with two decimals, no floating point
+    char payload[160];
+    int len = snprintf(payload, sizeof(payload),
+             "{ \"Span\": %u, \"IrmsMin\": %u.%02u, \"IrmsMax\": %u.%02u, \"IrmsMean\": %u.%02u,"
+             " \"IpeakHold\": %u.%02u }",
+             span_s[level], rms_min / 100, rms_min % 100, rms_max / 100, rms_max % 100,
+             rms_mean / 100, rms_mean % 100, peak_hold / 100, peak_hold % 100);
+
+    mqtt_send(TOPIC_SUMMARY, payload, len, 1);
     ESP_LOGI(TAG, "Published JSON: %s", payload);
 }
+
+// Publish JSON snapshot: { "Event": 3, "Source": 1, "Pre": 32, "I": [ ... mA ] }
+void mqtt_publish_capture(uint8_t event, uint8_t source, uint8_t pre,
+                          const int16_t *samples, int count)
+{
+    int size = 64 + count * 12;
+    char *payload = malloc(size);
+    if (!payload) return;
+
+    int len = snprintf(payload, size, "{ \"Event\": %u, \"Source\": %u, \"Pre\": %u, \"I\": [",
+                       event, source, pre);
+    for (int i = 0; i < count && len < size; i++) {
+        // mA with two decimals from the 0.01 mA value
+        int32_t c = ((int32_t)samples[i] * CAPTURE_LSB_CENTI + (1 << (CAPTURE_LSB_SHIFT - 1)))
+                    >> CAPTURE_LSB_SHIFT;
+        unsigned a = c < 0 ? -c : c;
+        len += snprintf(payload + len, size - len, "%s %s%u.%02u", i ? "," : "", c < 0 ? "-" : "",
+                        a / 100, a % 100);
+    }
+    if (len < size)
+        len += snprintf(payload + len, size - len, " ] }");
+    if (len >= size) len = size - 1;
+
+    mqtt_send(TOPIC_EVENT, payload, len, 1);
+    ESP_LOGI(TAG, "Published capture %u (%d samples)", event, count);
+    free(payload);
+}
+
+// Publish JSON waveform: { "Source": 2, "First": 4096, "X": [ ... ] }
+void mqtt_publish_wave(uint8_t source, uint16_t first, const int16_t *samples, int count)
+{
+    if (!mqtt_connected || !client) return;
+
+    int size = 64 + count * 7;
+    char *payload = malloc(size);
+    if (!payload) return;
+
+    int len = snprintf(payload, size, "{ \"Source\": %u, \"First\": %u, \"X\": [",
+                       source, first);
+    for (int i = 0; i < count && len < size; i++)
+        len += snprintf(payload + len, size - len, "%s%d", i ? "," : " ", samples[i]);
+    if (len < size)
+        snprintf(payload + len, size - len, " ] }");
+
+    esp_mqtt_client_publish(client, "/esp8266/sensor/wave", payload, 0, 0, 0);
+    free(payload);
+}
+
+void mqtt_set_config_handler(mqtt_config_handler_t handler)
+{
+    config_handler = handler;
+}
+
+void mqtt_publish_config_status(const char *json, int len)
+{
+    mqtt_send(TOPIC_CONFIG_STATUS, json, len, 1);
+    ESP_LOGI(TAG, "Config status: %.*s", len, json);
+}
+
+// Publish JSON link statistics: { "Frames": 1200, "Lost": 0, ... }
+void mqtt_publish_link(const mqtt_link_stats_t *st)
+{
+    if (!mqtt_connected || !client) return;
+
+    char payload[224];
+    snprintf(payload, sizeof(payload),
+             "{ \"Frames\": %u, \"Lost\": %u, \"CrcErrors\": %u, \"Depth\": %u, \"HighWater\": %u, \"Drops\": %u,"
+             " \"Spooled\": %u, \"SpoolDrops\": %u }",
+             st->frames, st->lost, st->crc_errors, st->depth, st->high_water, st->drops,
+             st->spooled, st->spool_drops);
+
+    esp_mqtt_client_publish(client, "/esp8266/sensor/link", payload, 0, 0, 0);
+}
+
+// --- Batched readings ---
+
+static mqtt_batch_config_t batch_cfg = {
+    BATCH_FORMAT_JSON, BATCH_SIZE_DEFAULT, BATCH_FLUSH_MS, BATCH_QOS
+};
+static mqtt_reading_t batch[BATCH_MAX];
+static int batch_count = 0;
+static TickType_t batch_started;
+
+void mqtt_batch_configure(const mqtt_batch_config_t *cfg)
+{
+    batch_cfg = *cfg;
+    if (batch_cfg.size == 0) batch_cfg.size = 1;
+    if (batch_cfg.size > BATCH_MAX) batch_cfg.size = BATCH_MAX;
+    if (batch_cfg.qos > 2) batch_cfg.qos = 2;
+}
+
+const mqtt_batch_config_t *mqtt_batch_config(void)
+{
+    return &batch_cfg;
+}
+
+// unsigned decimal without snprintf, returns the end
+static char *put_u32(char *p, uint32_t v)
+{
+    char tmp[10];
+    int n = 0;
+    do {
+        tmp[n++] = '0' + v % 10;
+        v /= 10;
+    } while (v);
+    while (n) *p++ = tmp[--n];
+    return p;
+}
+
+// { "N": 2, "R": [ [t, Ipeak, Irms, Freq, THD, H1, H3, H5, H7, H9,
+//                   Windows, IrmsMin, IrmsMax, IrmsMean, IpeakMax], ... ] }
+// A multi-channel batch adds "C": channels and [Ipeak, Irms] per input to each row
+static int batch_json(char *buf)
+{
+    char *p = buf;
+    int channels = batch[0].channels;
+
+    memcpy(p, "{\"N\":", 5);
+    p = put_u32(p + 5, batch_count);
+    if (channels) {
+        memcpy(p, ",\"C\":", 5);
+        p = put_u32(p + 5, channels);
+    }
+    memcpy(p, ",\"R\":[", 6);
+    p += 6;
+    for (int i = 0; i < batch_count; i++) {
+        const mqtt_reading_t *r = &batch[i];
+        if (i) *p++ = ',';
+        *p++ = '[';
+        p = put_u32(p, r->stamp);
+        *p++ = ',';
+        p = put_u32(p, r->peak);
+        *p++ = ',';
+        p = put_u32(p, r->rms);
+        *p++ = ',';
+        p = put_u32(p, r->freq);
+        *p++ = ',';
+        p = put_u32(p, r->thd);
+        for (int k = 0; k < HARMONICS; k++) {
+            *p++ = ',';
+            p = put_u32(p, r->harm[k]);
+        }
+        *p++ = ',';
+        p = put_u32(p, r->n);
+        *p++ = ',';
+        p = put_u32(p, r->rms_min);
+        *p++ = ',';
+        p = put_u32(p, r->rms_max);
+        *p++ = ',';
+        p = put_u32(p, r->rms_mean);
+        *p++ = ',';
+        p = put_u32(p, r->peak_max);
+        for (int c = 0; c < channels; c++) {
+            *p++ = ',';
+            p = put_u32(p, c < r->channels ? r->ch_peak[c] : 0);
+            *p++ = ',';
+            p = put_u32(p, c < r->channels ? r->ch_rms[c] : 0);
+        }
+        *p++ = ']';
+    }
+    *p++ = ']';
+    *p++ = '}';
+    return p - buf;
+}
+
+static uint8_t *put_be16(uint8_t *p, uint16_t v)
+{
+    *p++ = v >> 8;
+    *p++ = v;
+    return p;
+}
+
+// [version 0x02] [N] then per reading [t (4)] [Ipeak] [Irms] [Freq] [THD] [H1..H9]
+// [Windows] [IrmsMin] [IrmsMax] [IrmsMean] [IpeakMax], all big-endian;
+// multi-channel: [version 0x03] [N] [C] and [Ipeak] [Irms] per input appended
+static int batch_binary(uint8_t *buf)
+{
+    uint8_t *p = buf;
+    int channels = batch[0].channels;
+
+    *p++ = channels ? 0x03 : 0x02;
+    *p++ = batch_count;
+    if (channels) *p++ = channels;
+    for (int i = 0; i < batch_count; i++) {
+        const mqtt_reading_t *r = &batch[i];
+        p = put_be16(p, r->stamp >> 16);
+        p = put_be16(p, r->stamp);
+        p = put_be16(p, r->peak);
+        p = put_be16(p, r->rms);
+        p = put_be16(p, r->freq);
+        p = put_be16(p, r->thd);
+        for (int k = 0; k < HARMONICS; k++)
+            p = put_be16(p, r->harm[k]);
+        p = put_be16(p, r->n);
+        p = put_be16(p, r->rms_min);
+        p = put_be16(p, r->rms_max);
+        p = put_be16(p, r->rms_mean);
+        p = put_be16(p, r->peak_max);
+        for (int c = 0; c < channels; c++) {
+            p = put_be16(p, c < r->channels ? r->ch_peak[c] : 0);
+            p = put_be16(p, c < r->channels ? r->ch_rms[c] : 0);
+        }
+    }
+    return p - buf;
+}
+
+static void batch_flush(void)
+{
+    // worst case JSON per reading: a 10 digit stamp and 14 + 2 x CHANNELS_MAX
+    // five digit values, within SPOOL_MSG_MAX
+    static char buf[24 + BATCH_MAX * (11 + (14 + 2 * CHANNELS_MAX) * 6 + 3)];
+
+    if (!batch_count) return;
+
+    if (batch_cfg.format == BATCH_FORMAT_BINARY) {
+        int len = batch_binary((uint8_t *)buf);
+        mqtt_send(TOPIC_BATCH_BIN, buf, len, batch_cfg.qos);
+    } else {
+        int len = batch_json(buf);
+        mqtt_send(TOPIC_BATCH, buf, len, batch_cfg.qos);
+    }
+    batch_count = 0;
+}
+
+void mqtt_batch_add(const mqtt_reading_t *r)
+{
+    // one channel layout per message
+    if (batch_count && r->channels != batch[0].channels) batch_flush();
+    if (!batch_count) batch_started = xTaskGetTickCount();
+    batch[batch_count++] = *r;
+    if (batch_count >= batch_cfg.size) batch_flush();
+}
+
+// --- Report by exception ---
+
+static mqtt_report_config_t report_cfg = {
+    REPORT_DEADBAND_PEAK, REPORT_DEADBAND_RMS, REPORT_DEADBAND_FREQ,
+    REPORT_MIN_MS, REPORT_MAX_MS
+};
+static mqtt_reading_t last_reported;    // reference for the deadbands
+static mqtt_reading_t latest;           // newest reading, not yet reported
+static uint32_t agg_n, agg_sum;
+static uint16_t agg_min, agg_max, agg_peak;
+static bool report_pending;             // latest left the deadband, waiting for min_ms
+static bool reported_once;
+static TickType_t last_report;
+
+void mqtt_report_configure(const mqtt_report_config_t *cfg)
+{
+    report_cfg = *cfg;
+    if (report_cfg.max_ms < report_cfg.min_ms) report_cfg.max_ms = report_cfg.min_ms;
+}
+
+const mqtt_report_config_t *mqtt_report_config(void)
+{
+    return &report_cfg;
+}
+
+// A zero band lets every reading through, an unchanged one included
+static bool outside(uint16_t v, uint16_t ref, uint16_t band)
+{
+    return !band || (v > ref ? v - ref : ref - v) > band;
+}
+
+// Emit the latest reading with the aggregate of everything since the last row;
+// a step change goes out at once instead of waiting for the batch to fill
+static void report_emit(bool step)
+{
+    latest.n = agg_n > 0xFFFF ? 0xFFFF : agg_n;
+    latest.rms_min = agg_min;
+    latest.rms_max = agg_max;
+    latest.rms_mean = agg_sum / agg_n;
+    latest.peak_max = agg_peak;
+    mqtt_batch_add(&latest);
+    if (step) batch_flush();
+
+    last_reported = latest;
+    reported_once = true;
+    report_pending = false;
+    last_report = xTaskGetTickCount();
+    agg_n = 0;
+}
+
+static void report_check(void)
+{
+    if (!agg_n) return;
+
+    TickType_t since = xTaskGetTickCount() - last_report;
+    if (report_pending && since >= pdMS_TO_TICKS(report_cfg.min_ms))
+        report_emit(true);
+    else if (since >= pdMS_TO_TICKS(report_cfg.max_ms))
+        report_emit(false);
+}
+
+void mqtt_report_add(const mqtt_reading_t *r)
+{
+    if (!agg_n) {
+        agg_sum = 0;
+        agg_min = 0xFFFF;
+        agg_max = 0;
+        agg_peak = 0;
+    }
+    agg_n++;
+    agg_sum += r->rms;
+    if (r->rms < agg_min) agg_min = r->rms;
+    if (r->rms > agg_max) agg_max = r->rms;
+    if (r->peak > agg_peak) agg_peak = r->peak;
+    latest = *r;
+
+    if (!reported_once
+        || outside(r->peak, last_reported.peak, report_cfg.deadband_peak)
+        || outside(r->rms, last_reported.rms, report_cfg.deadband_rms)
+        || outside(r->freq, last_reported.freq, report_cfg.deadband_freq)
+        || r->channels != last_reported.channels)
+        report_pending = true;
+    for (int c = 0; c < r->channels && c < last_reported.channels; c++) {
+        if (outside(r->ch_peak[c], last_reported.ch_peak[c], report_cfg.deadband_peak)
+            || outside(r->ch_rms[c], last_reported.ch_rms[c], report_cfg.deadband_rms))
+            report_pending = true;
+    }
+    report_check();
+}
+
+void mqtt_batch_poll(void)
+{
+    report_check();
+    if (batch_count && xTaskGetTickCount() - batch_started >= pdMS_TO_TICKS(batch_cfg.flush_ms))
+        batch_flush();
+}
@@ -6,7 +6,128 @@
 // Initialize Wi-Fi and MQTT
 void mqtt_init(const char* ssid, const char* password, const char* mqtt_uri);
 
-// Publish values in JSON format
-void mqtt_publish_values(uint16_t Ipeak, uint16_t Irms, uint16_t Freq);
+// Odd harmonics 1, 3, 5, 7, 9 carried in the measurement frame
+#define HARMONICS 5
+
+// Inputs of a multi-channel AVR build (SPI_REC_CHANNELS), e.g. three phases and neutral
+#define CHANNELS_MAX 4
+
+// Publish a 1 s / 10 s / 60 s summary (level 0 / 1 / 2) in JSON format
+void mqtt_publish_summary(uint8_t level, uint16_t rms_min, uint16_t rms_max,
+                          uint16_t rms_mean, uint16_t peak_hold);
+
+// Integrated current LSB of captured samples, CAPTURE_LSB_CENTI / 2^CAPTURE_LSB_SHIFT
+// in 0.01 mA (CENTI_SCALE and CENTI_SHIFT in the AVR's rms.h)
+#define CAPTURE_LSB_CENTI 847
+#define CAPTURE_LSB_SHIFT 5
+
+// Publish a transient snapshot; samples[pre] is the trigger sample
+void mqtt_publish_capture(uint8_t event, uint8_t source, uint8_t pre,
+                          const int16_t *samples, int count);
+
+// Publish a stretch of streamed waveform (raw LSB of the selected tap point),
+// first is the AVR sample index of samples[0]; QoS 0, newer data replaces lost data
+void mqtt_publish_wave(uint8_t source, uint16_t first, const int16_t *samples, int count);
+
+// --- Batched readings ---
+#define BATCH_FORMAT_JSON    0   // integer JSON, see README
+#define BATCH_FORMAT_BINARY  1   // packed big-endian records
+
+#define BATCH_SIZE_DEFAULT   10      // readings per message, at most BATCH_MAX
+#define BATCH_MAX            24      // worst case JSON with CHANNELS_MAX inputs fits SPOOL_MSG_MAX
+#define BATCH_FLUSH_MS       2000    // publish a partial batch after this long
+#define BATCH_QOS            0
+
+typedef struct {
+    uint32_t stamp;         // AVR sample clock at the end of the window
+    uint16_t peak, rms;     // 0.01 mA
+    uint16_t freq;          // 0.01 Hz
+    uint16_t thd;           // 0.1 %
+    uint16_t harm[HARMONICS];
+    // every input of a multi-channel build, channels = 0 otherwise
+    uint8_t  channels;
+    uint16_t ch_peak[CHANNELS_MAX], ch_rms[CHANNELS_MAX];
+    // windows since the previous row, filled in by mqtt_report_add()
+    uint16_t n;
+    uint16_t rms_min, rms_max, rms_mean;
+    uint16_t peak_max;
+} mqtt_reading_t;
+
+typedef struct {
+    uint8_t  format;
+    uint8_t  size;
+    uint32_t flush_ms;
+    uint8_t  qos;
+} mqtt_batch_config_t;
+
+// Set from the config topic (config_relay.h), applied to the next reading
+void mqtt_batch_configure(const mqtt_batch_config_t *cfg);
+const mqtt_batch_config_t *mqtt_batch_config(void);
+
+// Add one reading; publishes when the batch is full
+void mqtt_batch_add(const mqtt_reading_t *r);
+
+// Publish a partial batch once it is older than flush_ms, and a held reading
+// once min_ms or max_ms has passed; call periodically
+void mqtt_batch_poll(void);
+
+// --- Report by exception ---
+// A reading becomes a batch row only when Ipeak, Irms or Freq (or the peak
+// or RMS of any input) leaves the deadband around the last reported value
+// (no sooner than min_ms after it), or as a heartbeat after max_ms. Each row carries min/max/mean Irms and the
+// peak of every window it stands for. Zero deadbands and min_ms report all.
+#define REPORT_DEADBAND_PEAK   50      // 0.01 mA
+#define REPORT_DEADBAND_RMS    20      // 0.01 mA
+#define REPORT_DEADBAND_FREQ   5       // 0.01 Hz
+#define REPORT_MIN_MS          500
+#define REPORT_MAX_MS          30000   // heartbeat
+
+typedef struct {
+    uint16_t deadband_peak, deadband_rms, deadband_freq;
+    uint32_t min_ms, max_ms;
+} mqtt_report_config_t;
+
+// Set from the config topic (config_relay.h); max_ms is raised to min_ms
+void mqtt_report_configure(const mqtt_report_config_t *cfg);
+const mqtt_report_config_t *mqtt_report_config(void);
+
+// Feed every reading; aggregates it and adds a row to the batch when due
+void mqtt_report_add(const mqtt_reading_t *r);
+
+// --- Runtime configuration ---
+#define CONFIG_TOPIC         "/esp8266/sensor/config"
+#define CONFIG_STATUS_TOPIC  "/esp8266/sensor/config/status"
+
+// Called from the MQTT task with each message on CONFIG_TOPIC
+typedef void (*mqtt_config_handler_t)(const char *data, int len);
+void mqtt_set_config_handler(mqtt_config_handler_t handler);
+
+// Publish the settings the AVR acknowledged (QoS 1, spooled while offline)
+void mqtt_publish_config_status(const char *json, int len);
+
+// SPI link and record queue counters
+typedef struct {
+    uint32_t frames;        // valid frames received
+    uint32_t lost;          // frames missing from the sequence
+    uint32_t crc_errors;
+    uint32_t depth;         // records waiting for the publisher
+    uint32_t high_water;
+    uint32_t drops;         // records lost to a full queue
+    uint32_t spooled;       // messages waiting for the broker, RAM and flash
+    uint32_t spool_drops;   // messages lost to a full spool
+} mqtt_link_stats_t;
+
+// --- Store-and-forward ---
+// Batches, summaries and captures that cannot be published go to the spool
+// (spool.h) and are replayed oldest first once the broker is back.
+// Waveform and link statistics are live data and are not spooled.
+#define SPOOL_REPLAY_PER_POLL  2       // messages replayed per mqtt_spool_poll()
+#define SPOOL_SYNC_MS          10000   // spill the RAM spool to flash this often while offline
+
+// Replay spooled messages, or sync them to flash while offline; call periodically
+void mqtt_spool_poll(void);
+
+// Publish link statistics in JSON format
+void mqtt_publish_link(const mqtt_link_stats_t *st);
 
 #endif // MQTT_PUBLISH_H
@@ -0,0 +1,46 @@
+#include "record_queue.h"
+#include <string.h>
+
+// entry contents must be visible before the index that publishes them
+#define barrier() __sync_synchronize()
+
+void rec_queue_init(rec_queue_t *q)
+{
+    memset(q, 0, sizeof(*q));
+}
+
+rec_entry_t *rec_queue_claim(rec_queue_t *q)
+{
+    if (q->head - q->tail >= REC_QUEUE_LEN) {
+        q->drops++;
+        return NULL;
+    }
+    return &q->entry[q->head & (REC_QUEUE_LEN - 1)];
+}
+
+void rec_queue_commit(rec_queue_t *q)
+{
+    barrier();
+    q->head++;
+
+    uint32_t depth = q->head - q->tail;
+    if (depth > q->high_water) q->high_water = depth;
+}
+
+rec_entry_t *rec_queue_peek(rec_queue_t *q)
+{
+    if (q->head == q->tail) return NULL;
+    barrier();
+    return &q->entry[q->tail & (REC_QUEUE_LEN - 1)];
+}
+
+void rec_queue_release(rec_queue_t *q)
+{
+    barrier();
+    q->tail++;
+}
+
+uint32_t rec_queue_depth(const rec_queue_t *q)
+{
+    return q->head - q->tail;
+}
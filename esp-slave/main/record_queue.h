@@ -0,0 +1,42 @@
+#ifndef RECORD_QUEUE_H
+#define RECORD_QUEUE_H
+
+#include <stdint.h>
+
+#define REC_QUEUE_LEN  64     // entries, power of 2
+// Largest record payload: a wave chunk of 16 samples (WAVE_CHUNK in the AVR's
+// wave.h) sent raw, since the AVR drops delta coding when it would be longer
+#define REC_DATA_MAX   (5 + 2 * 16)
+
+// One parsed SPI record, as handed from the receive task to the publisher
+typedef struct {
+    uint32_t stamp;           // AVR sample clock, end of the window for current records
+    uint8_t  type;
+    uint8_t  len;
+    uint8_t  data[REC_DATA_MAX];
+} rec_entry_t;
+
+/* Lock-free single-producer / single-consumer ring: the receive task
+   claims and commits, the publisher task peeks and releases. Indices run
+   free and are only written by their owner. */
+typedef struct {
+    rec_entry_t entry[REC_QUEUE_LEN];
+    volatile uint32_t head;   // producer
+    volatile uint32_t tail;   // consumer
+    uint32_t high_water;
+    uint32_t drops;           // records lost to a full ring
+} rec_queue_t;
+
+void rec_queue_init(rec_queue_t *q);
+
+// Producer: a free entry or NULL (counted as a drop) when the ring is full
+rec_entry_t *rec_queue_claim(rec_queue_t *q);
+void rec_queue_commit(rec_queue_t *q);
+
+// Consumer: the oldest entry or NULL when empty
+rec_entry_t *rec_queue_peek(rec_queue_t *q);
+void rec_queue_release(rec_queue_t *q);
+
+uint32_t rec_queue_depth(const rec_queue_t *q);
+
+#endif // RECORD_QUEUE_H
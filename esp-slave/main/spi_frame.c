@@ -0,0 +1,123 @@
+#include "spi_frame.h"
+#include <string.h>
+
+static uint16_t crc16_ccitt(const uint8_t *d, int n)
+{
+    uint16_t crc = 0xFFFF;
+    while (n--) {
+        crc ^= (uint16_t)*d++ << 8;
+        for (int i = 0; i < 8; i++)
+            crc = (crc & 0x8000) ? (crc << 1) ^ 0x1021 : crc << 1;
+    }
+    return crc;
+}
+
+void spi_parser_init(spi_parser_t *p)
+{
+    memset(p, 0, sizeof(*p));
+    p->last_seq = -1;
+}
+
+int spi_parser_feed(spi_parser_t *p, uint8_t byte, spi_frame_t *f)
+{
+    if (p->pos == 0) {
+        // hunting: padding and garbage until the next SOF
+        if (byte == SPI_SOF) p->buf[p->pos++] = byte;
+        return 0;
+    }
+
+    p->buf[p->pos++] = byte;
+
+    if (p->pos == 3) {
+        p->total = 3 + byte + SPI_FRAME_CRC;
+        if (byte < SPI_FRAME_HEAD - 3 || p->total > SPI_FRAME_MAX) {
+            p->pos = 0;             // not a frame header, resync
+            return 0;
+        }
+    }
+    if (p->pos < 3 || p->pos < p->total) return 0;
+
+    // complete frame
+    const uint8_t *b = p->buf;
+    int n = p->total;
+    p->pos = 0;
+
+    uint16_t crc = (b[n - 2] << 8) | b[n - 1];
+    if (crc16_ccitt(b + 1, n - 3) != crc) {
+        p->crc_errors++;
+        return 0;
+    }
+    if (b[1] != SPI_VERSION) return 0;
+
+    p->frames++;
+    if (p->last_seq >= 0)
+        p->lost += (uint8_t)(b[3] - p->last_seq - 1);
+    p->last_seq = b[3];
+
+    f->version = b[1];
+    f->seq = b[3];
+    f->stamp = ((uint32_t)b[4] << 24) | ((uint32_t)b[5] << 16) | (b[6] << 8) | b[7];
+    f->nrec = b[8];
+    f->records = b + SPI_FRAME_HEAD;
+    f->len = n - SPI_FRAME_HEAD - SPI_FRAME_CRC;
+    return 1;
+}
+
+int spi_wave_decode(const uint8_t *d, uint8_t len, int16_t *out, int max)
+{
+    if (len < 5) return -1;
+    uint8_t flags = d[1];
+    int n = d[4];
+    const uint8_t *p = d + 5, *end = d + len;
+
+    if (n > max) return -1;
+    for (int i = 0; i < n; i++) {
+        if (p >= end) return -1;
+        if (!(flags & WAVE_DELTA) || i == 0 || *p == WAVE_DELTA_ESC) {
+            if (i && (flags & WAVE_DELTA)) p++;     // escape byte
+            if (p + 2 > end) return -1;
+            out[i] = (int16_t)((p[0] << 8) | p[1]);
+            p += 2;
+        } else {
+            if (p + 1 > end) return -1;
+            out[i] = out[i - 1] + (int8_t)*p++;
+        }
+    }
+    return n;
+}
+
+int spi_frame_record(const spi_frame_t *f, uint8_t *offset,
+                     uint8_t *type, const uint8_t **data, uint8_t *len)
+{
+    uint8_t o = *offset;
+
+    if (o + 2 > f->len) return 0;
+    if (o + 2 + f->records[o + 1] > f->len) return 0;
+
+    *type = f->records[o];
+    *len = f->records[o + 1];
+    *data = f->records + o + 2;
+    *offset = o + 2 + *len;
+    return 1;
+}
+
+void spi_command_build(uint8_t *buf, uint8_t seq, const uint8_t *keys,
+                       const uint16_t *values, int n)
+{
+    if (n > SPI_CMD_MAX) n = SPI_CMD_MAX;
+
+    memset(buf, 0, SPI_CMD_BYTES);
+    buf[0] = SPI_CMD_SOF;
+    buf[1] = SPI_CMD_VERSION;
+    buf[2] = seq;
+    buf[3] = n;
+    for (int i = 0; i < n; i++) {
+        buf[SPI_CMD_HEAD + 3 * i] = keys[i];
+        buf[SPI_CMD_HEAD + 3 * i + 1] = values[i] >> 8;
+        buf[SPI_CMD_HEAD + 3 * i + 2] = values[i];
+    }
+
+    uint16_t crc = crc16_ccitt(buf + 1, SPI_CMD_BYTES - 3);
+    buf[SPI_CMD_BYTES - 2] = crc >> 8;
+    buf[SPI_CMD_BYTES - 1] = crc;
+}
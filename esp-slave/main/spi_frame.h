@@ -0,0 +1,76 @@
+#ifndef SPI_FRAME_H
+#define SPI_FRAME_H
+
+#include <stdint.h>
+
+/* Frame from the ATmega328P, multi-byte fields MSB first:
+   [SOF 0xA5] [version] [len] [seq] [timestamp, 4] [nrec] [records] [CRC16, 2]
+   len counts seq .. last record, CRC-16/CCITT-FALSE over version .. last
+   record. Record: [type] [len] [payload]. Frames arrive as a byte stream,
+   split over 32-byte HSPI writes and padded with 0x00. */
+#define SPI_SOF           0xA5
+#define SPI_VERSION       0x01
+#define SPI_FRAME_MAX     128
+#define SPI_FRAME_HEAD    9
+#define SPI_FRAME_CRC     2
+
+#define SPI_REC_CURRENT   0x00   // count, peak, rms, freq, thd, harmonics 1/3/5/7/9
+#define SPI_REC_AGGREGATE 0x01   // level, rms min, rms max, rms mean, peak hold
+#define SPI_REC_CAPTURE   0x02   // event, chunk, chunks, source, pre, 12 samples
+#define SPI_REC_WAVE      0x03   // source, flags, first sample index (2), n, samples
+#define SPI_REC_CONFIG    0x04   // seq, n, [key, applied value (2)] x n
+#define SPI_REC_CHANNELS  0x05   // n, [peak, rms] x n, multi-channel AVR builds only
+
+#define WAVE_DELTA        0x01   // first sample absolute, then int8 deltas
+#define WAVE_DELTA_ESC    0x80   // delta escape: absolute int16 follows
+
+/* Command packet to the ATmega328P, placed in the HSPI read buffer that the
+   master polls: [SOF 0x5A] [version] [seq] [n] [key, value (2)] x n, zero
+   padded, [CRC16, 2] in the last two bytes over version .. padding. The
+   master applies a packet once per seq, so seq must change (and skips 0). */
+#define SPI_CMD_BYTES     32
+#define SPI_CMD_SOF       0x5A
+#define SPI_CMD_VERSION   0x01
+#define SPI_CMD_HEAD      4
+#define SPI_CMD_MAX       8     // settings per packet
+
+void spi_command_build(uint8_t *buf, uint8_t seq, const uint8_t *keys,
+                       const uint16_t *values, int n);
+
+/* Decode the samples of a SPI_REC_WAVE payload into out (max samples);
+   returns the sample count or -1 if the record is malformed */
+int spi_wave_decode(const uint8_t *d, uint8_t len, int16_t *out, int max);
+
+typedef struct {
+    uint8_t  buf[SPI_FRAME_MAX];
+    uint16_t pos;
+    uint16_t total;             // frame length once len is known
+
+    // link statistics
+    uint32_t frames;
+    uint32_t crc_errors;
+    uint32_t lost;              // frames missing from the sequence
+    int      last_seq;          // -1 until the first frame
+} spi_parser_t;
+
+typedef struct {
+    uint8_t  version;
+    uint8_t  seq;
+    uint32_t stamp;             // sample clock at the end of the first window
+    uint8_t  nrec;
+    const uint8_t *records;
+    uint8_t  len;               // bytes of records
+} spi_frame_t;
+
+void spi_parser_init(spi_parser_t *p);
+
+/* Feed one stream byte; returns 1 and fills *f when a frame with a valid
+   CRC is complete (f points into the parser buffer until the next call) */
+int spi_parser_feed(spi_parser_t *p, uint8_t byte, spi_frame_t *f);
+
+/* Walk the records of a frame: returns 1 and sets type/data/len for the
+   record at *offset, advancing it, or 0 at the end or on a malformed record */
+int spi_frame_record(const spi_frame_t *f, uint8_t *offset,
+                     uint8_t *type, const uint8_t **data, uint8_t *len);
+
+#endif // SPI_FRAME_H
@@ -0,0 +1,310 @@
+#include "spool.h"
+#include "esp_log.h"
+#include "esp_partition.h"
+#include <string.h>
+
+static const char *TAG = "SPOOL";
+
+// --- RAM ring: [len hi][len lo][topic][qos][payload], free-running byte indices ---
+#define RAM_HDR 4
+
+static uint8_t ram[SPOOL_RAM_BYTES];
+static uint32_t ram_head, ram_tail, ram_msgs;
+
+// --- Flash log: circular sequence of sectors, each [sector_hdr_t][records] ---
+#define SECTOR_SIZE   4096
+#define SECTOR_MAGIC  0x4C4F5053    // "SPOL"
+#define REC_MAGIC     0x5A5A
+#define REC_PENDING   0xFF
+#define REC_SENT      0x00          // programmed over REC_PENDING once replayed
+
+typedef struct {
+    uint32_t magic;
+    uint32_t seq;
+} sector_hdr_t;
+
+typedef struct {
+    uint16_t magic;
+    uint16_t len;
+    uint8_t  topic;
+    uint8_t  qos;
+    uint8_t  state;
+    uint8_t  pad;
+} rec_hdr_t;
+
+static const esp_partition_t *part = NULL;
+static uint32_t sectors;
+static uint32_t wr_sector, wr_off, wr_seq;
+static uint32_t rd_sector, rd_off;
+static uint32_t flash_msgs;
+
+static uint8_t scratch[SECTOR_SIZE];
+static int peeked_flash;
+static uint32_t spilled, dropped;
+
+#define ALIGN4(n) (((n) + 3) & ~3u)
+
+static void ram_copy_in(uint32_t pos, const void *src, uint32_t n)
+{
+    const uint8_t *s = src;
+    while (n--) ram[pos++ % SPOOL_RAM_BYTES] = *s++;
+}
+
+static void ram_copy_out(uint32_t pos, void *dst, uint32_t n)
+{
+    uint8_t *d = dst;
+    while (n--) *d++ = ram[pos++ % SPOOL_RAM_BYTES];
+}
+
+static int flash_empty(void)
+{
+    return !part || (rd_sector == wr_sector && rd_off == wr_off);
+}
+
+static int read_rec(uint32_t sector, uint32_t off, rec_hdr_t *h)
+{
+    if (off + sizeof(*h) > SECTOR_SIZE) return 0;
+    if (esp_partition_read(part, sector * SECTOR_SIZE + off, h, sizeof(*h)) != ESP_OK) return 0;
+    return h->magic == REC_MAGIC && sizeof(*h) + ALIGN4(h->len) <= SECTOR_SIZE - off;
+}
+
+// Move the read position onto the next pending record, or onto the write position
+static void flash_normalize_read(void)
+{
+    rec_hdr_t h;
+
+    for (;;) {
+        if (rd_sector == wr_sector && rd_off >= wr_off) {
+            rd_off = wr_off;
+            return;
+        }
+        if (read_rec(rd_sector, rd_off, &h)) {
+            if (h.state == REC_PENDING) return;
+            rd_off += sizeof(h) + ALIGN4(h.len);
+            continue;
+        }
+        rd_sector = (rd_sector + 1) % sectors;
+        rd_off = sizeof(sector_hdr_t);
+    }
+}
+
+static void flash_open_sector(uint32_t sector)
+{
+    sector_hdr_t sh = { SECTOR_MAGIC, ++wr_seq };
+
+    esp_partition_erase_range(part, sector * SECTOR_SIZE, SECTOR_SIZE);
+    esp_partition_write(part, sector * SECTOR_SIZE, &sh, sizeof(sh));
+    wr_sector = sector;
+    wr_off = sizeof(sh);
+}
+
+// Pending records from the read position to the end of its sector
+static uint32_t flash_count_sector(uint32_t sector, uint32_t off)
+{
+    rec_hdr_t h;
+    uint32_t n = 0;
+
+    while ((sector != wr_sector || off < wr_off) && read_rec(sector, off, &h)) {
+        if (h.state == REC_PENDING) n++;
+        off += sizeof(h) + ALIGN4(h.len);
+    }
+    return n;
+}
+
+static void flash_append(const rec_hdr_t *h, const uint8_t *rec)
+{
+    uint32_t need = sizeof(*h) + ALIGN4(h->len);
+    int was_empty = flash_empty();
+
+    if (wr_off + need > SECTOR_SIZE) {
+        uint32_t next = (wr_sector + 1) % sectors;
+
+        if (!was_empty && next == rd_sector) {
+            // log full: the oldest sector goes
+            uint32_t lost = flash_count_sector(rd_sector, rd_off);
+            dropped += lost;
+            flash_msgs -= lost;
+            rd_sector = (next + 1) % sectors;
+            rd_off = sizeof(sector_hdr_t);
+            ESP_LOGW(TAG, "Flash spool full, dropped %u messages", lost);
+        }
+        flash_open_sector(next);
+        if (!was_empty) flash_normalize_read();
+    }
+
+    esp_partition_write(part, wr_sector * SECTOR_SIZE + wr_off, rec, need);
+    if (was_empty) {
+        rd_sector = wr_sector;
+        rd_off = wr_off;
+    }
+    wr_off += need;
+    flash_msgs++;
+}
+
+// Oldest RAM message to flash, or to the floor without a partition
+static void spill_one(void)
+{
+    uint8_t hdr[RAM_HDR];
+    ram_copy_out(ram_tail, hdr, RAM_HDR);
+    uint16_t len = (hdr[0] << 8) | hdr[1];
+
+    if (part) {
+        rec_hdr_t h = { REC_MAGIC, len, hdr[2], hdr[3], REC_PENDING, 0xFF };
+        memcpy(scratch, &h, sizeof(h));
+        ram_copy_out(ram_tail + RAM_HDR, scratch + sizeof(h), len);
+        memset(scratch + sizeof(h) + len, 0xFF, ALIGN4(len) - len);
+        flash_append(&h, scratch);
+        spilled++;
+    } else {
+        dropped++;
+    }
+
+    ram_tail += RAM_HDR + len;
+    ram_msgs--;
+}
+
+void spool_init(void)
+{
+    part = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, SPOOL_SUBTYPE, SPOOL_PARTITION);
+    if (!part || part->size < 2 * SECTOR_SIZE) {
+        ESP_LOGW(TAG, "No spool partition, buffering in RAM only");
+        part = NULL;
+        return;
+    }
+    sectors = part->size / SECTOR_SIZE;
+
+    // the newest sector takes the writes
+    int found = 0;
+    for (uint32_t s = 0; s < sectors; s++) {
+        sector_hdr_t sh;
+        if (esp_partition_read(part, s * SECTOR_SIZE, &sh, sizeof(sh)) != ESP_OK) continue;
+        if (sh.magic == SECTOR_MAGIC && (!found || sh.seq > wr_seq)) {
+            wr_seq = sh.seq;
+            wr_sector = s;
+            found = 1;
+        }
+    }
+    if (!found) {
+        flash_open_sector(0);
+        rd_sector = wr_sector;
+        rd_off = wr_off;
+        return;
+    }
+
+    rec_hdr_t h;
+    wr_off = sizeof(sector_hdr_t);
+    while (read_rec(wr_sector, wr_off, &h))
+        wr_off += sizeof(h) + ALIGN4(h.len);
+
+    // sectors are written in a circle: the oldest valid one follows the newest
+    for (uint32_t k = 1; k <= sectors; k++) {
+        uint32_t s = (wr_sector + k) % sectors;
+        sector_hdr_t sh;
+        esp_partition_read(part, s * SECTOR_SIZE, &sh, sizeof(sh));
+        if (sh.magic == SECTOR_MAGIC) {
+            rd_sector = s;
+            rd_off = sizeof(sh);
+            break;
+        }
+    }
+    flash_normalize_read();
+
+    for (uint32_t s = rd_sector, off = rd_off; ; s = (s + 1) % sectors, off = sizeof(sector_hdr_t)) {
+        flash_msgs += flash_count_sector(s, off);
+        if (s == wr_sector) break;
+    }
+    ESP_LOGI(TAG, "Spool partition %u sectors, %u messages to replay", sectors, flash_msgs);
+}
+
+int spool_put(uint8_t topic, uint8_t qos, const void *data, uint16_t len)
+{
+    if (len > SPOOL_MSG_MAX) return -1;
+
+    while (SPOOL_RAM_BYTES - (ram_head - ram_tail) < RAM_HDR + (uint32_t)len)
+        spill_one();
+
+    uint8_t hdr[RAM_HDR] = { len >> 8, len, topic, qos };
+    ram_copy_in(ram_head, hdr, RAM_HDR);
+    ram_copy_in(ram_head + RAM_HDR, data, len);
+    ram_head += RAM_HDR + len;
+    ram_msgs++;
+    return 0;
+}
+
+int spool_peek(uint8_t *topic, uint8_t *qos, void *buf, uint16_t max)
+{
+    if (!flash_empty()) {
+        rec_hdr_t h;
+        if (!read_rec(rd_sector, rd_off, &h) || h.len > max) {
+            // unreadable: skip it rather than stall the replay
+            peeked_flash = 1;
+            spool_pop();
+            return spool_peek(topic, qos, buf, max);
+        }
+        esp_partition_read(part, rd_sector * SECTOR_SIZE + rd_off + sizeof(h), buf, h.len);
+        *topic = h.topic;
+        *qos = h.qos;
+        peeked_flash = 1;
+        return h.len;
+    }
+
+    if (!ram_msgs) return -1;
+
+    uint8_t hdr[RAM_HDR];
+    ram_copy_out(ram_tail, hdr, RAM_HDR);
+    uint16_t len = (hdr[0] << 8) | hdr[1];
+    if (len > max) {
+        ram_tail += RAM_HDR + len;
+        ram_msgs--;
+        dropped++;
+        return spool_peek(topic, qos, buf, max);
+    }
+    ram_copy_out(ram_tail + RAM_HDR, buf, len);
+    *topic = hdr[2];
+    *qos = hdr[3];
+    peeked_flash = 0;
+    return len;
+}
+
+void spool_pop(void)
+{
+    if (peeked_flash) {
+        if (flash_empty()) return;
+
+        rec_hdr_t h;
+        if (read_rec(rd_sector, rd_off, &h)) {
+            // clear the state byte in place, flash bits only go 1 -> 0
+            h.state = REC_SENT;
+            esp_partition_write(part, rd_sector * SECTOR_SIZE + rd_off + 4, (uint8_t *)&h + 4, 4);
+            rd_off += sizeof(h) + ALIGN4(h.len);
+        } else {
+            rd_off = SECTOR_SIZE;
+        }
+        flash_msgs--;
+        flash_normalize_read();
+    } else if (ram_msgs) {
+        uint8_t hdr[RAM_HDR];
+        ram_copy_out(ram_tail, hdr, RAM_HDR);
+        ram_tail += RAM_HDR + ((hdr[0] << 8) | hdr[1]);
+        ram_msgs--;
+    }
+}
+
+void spool_sync(void)
+{
+    while (part && ram_msgs)
+        spill_one();
+}
+
+int spool_empty(void)
+{
+    return flash_empty() && !ram_msgs;
+}
+
+void spool_stats(spool_stats_t *st)
+{
+    st->ram_msgs = ram_msgs;
+    st->flash_msgs = flash_msgs;
+    st->spilled = spilled;
+    st->dropped = dropped;
+}
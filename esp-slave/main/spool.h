@@ -0,0 +1,42 @@
+#ifndef SPOOL_H
+#define SPOOL_H
+
+#include <stdint.h>
+
+/* Store-and-forward queue for MQTT messages that could not be published.
+   Messages collect in a RAM ring; when it is full (or on spool_sync()) the
+   oldest ones spill to an append-only log in the "spool" flash partition,
+   which survives a reset. spool_peek() always returns the oldest message,
+   flash before RAM. Only the publisher task may call these. */
+
+#define SPOOL_RAM_BYTES      8192
+#define SPOOL_MSG_MAX        4000    // payload bytes, fits one flash sector
+#define SPOOL_PARTITION      "spool"
+#define SPOOL_SUBTYPE        0x40    // custom data subtype, see partitions.csv
+
+typedef struct {
+    uint32_t ram_msgs;
+    uint32_t flash_msgs;
+    uint32_t spilled;       // messages moved from RAM to flash
+    uint32_t dropped;       // oldest messages lost to a full spool
+} spool_stats_t;
+
+// Find the partition and recover the log left by the previous run
+void spool_init(void);
+
+// Queue a message; returns 0, or -1 if it is larger than SPOOL_MSG_MAX
+int spool_put(uint8_t topic, uint8_t qos, const void *data, uint16_t len);
+
+// Oldest message: copies it to buf and returns its length, -1 when empty
+int spool_peek(uint8_t *topic, uint8_t *qos, void *buf, uint16_t max);
+
+// Remove the message returned by the last spool_peek()
+void spool_pop(void);
+
+// Spill everything in RAM to flash
+void spool_sync(void);
+
+int spool_empty(void);
+void spool_stats(spool_stats_t *st);
+
+#endif // SPOOL_H
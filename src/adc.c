@@ -0,0 +1,165 @@
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <util/atomic.h>
+#include <string.h>
+#include "adc.h"
+#include "cic.h"
+#include "timer.h"
+
+static dsp_window_t window;                // last closed window
+static volatile uint8_t sample_idx = 0;
+static volatile uint8_t blocks_ready = 0;  // window owned by the main loop
+static volatile uint16_t dropped_blocks = 0;
+static volatile uint8_t window_len = SAMPLE_COUNT;
+static volatile uint16_t center = ADC_CENTER_DEFAULT;   // coarse offset, calib.h
+
+// --- Oversampling front end, one decimator per input ---
+static cic_state_t cic[ADC_CHANNELS];
+static volatile uint8_t decim_log2 = ADC_DECIM_LOG2_DEFAULT;
+static uint8_t decim_phase = 0;
+static uint8_t channel = 0;                // input being converted
+
+// decimated sample sets waiting for the pipeline, filled by nested ISR entries
+static int16_t pending[ADC_PENDING][ADC_CHANNELS];
+static uint8_t pending_head = 0, pending_tail = 0;
+static uint8_t pipeline_busy = 0;
+static volatile uint16_t pending_overruns = 0;
+
+void adc_init(void)
+{
+    dsp_init();
+    ADMUX = (1 << REFS0);
+    // conversions auto-triggered by Timer1 compare match B, no start jitter
+    ADCSRB = (1 << ADTS2) | (1 << ADTS0);
+    ADCSRA = (1 << ADEN) | (1 << ADIE) | (1 << ADATE) | (1 << ADPS2) | (1 << ADPS1) | (1 << ADPS0);
+    adc_set_decimation(ADC_DECIM_LOG2_DEFAULT);
+}
+
+void adc_set_decimation(uint8_t log2r)
+{
+    if (log2r > ADC_DECIM_LOG2_MAX) log2r = ADC_DECIM_LOG2_MAX;
+
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        // ADC clock 125 kHz (13 us conversions at 1x) or 250 kHz when oversampling
+        ADCSRA = (ADCSRA & ~((1 << ADPS2) | (1 << ADPS1) | (1 << ADPS0)))
+                 | (log2r ? (1 << ADPS2) | (1 << ADPS1) : (1 << ADPS2) | (1 << ADPS1) | (1 << ADPS0));
+        decim_log2 = log2r;
+        decim_phase = 0;
+        memset(cic, 0, sizeof(cic));
+    }
+    timer1_set_oversampling(log2r);
+}
+
+void adc_set_center(uint16_t c)
+{
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        center = c;
+    }
+}
+
+uint8_t adc_decimation(void)
+{
+    return decim_log2;
+}
+
+// one decimated sample per channel through the DSP pipeline and window bookkeeping
+static void adc_process(const int16_t *x)
+{
+    uint8_t idx = sample_idx;
+    dsp_push(x);
+
+    if (++idx >= window_len)
+    {
+        idx = 0;
+        if (!blocks_ready)
+        {
+            dsp_close_window(&window);
+            blocks_ready = 1;
+        }
+        else
+        {
+            // overrun: main loop still holds the block, drop this window
+            dsp_close_window(0);
+            dropped_blocks++;
+        }
+    }
+    sample_idx = idx;
+}
+
+ISR(ADC_vect)
+{
+    int16_t x = (int16_t)(ADC - center);   // coarse centering, the DSP tracks the rest
+    uint8_t ch = channel;
+    if (ADC_CHANNELS > 1)
+    {
+        // ADMUX is safe to change until the trigger flag is cleared: the
+        // next conversion, one trigger period away, takes the next input
+        channel = (ch + 1 < ADC_CHANNELS) ? ch + 1 : 0;
+        ADMUX = (1 << REFS0) | channel;
+    }
+    TIFR1 = (1 << OCF1B);             // re-arm the auto trigger
+
+    cic_integrate(&cic[ch], x);
+    if (ADC_CHANNELS > 1 && channel) return;   // round not complete yet
+    if (++decim_phase < (1 << decim_log2)) return;
+    decim_phase = 0;
+
+    uint8_t head = (pending_head + 1) & (ADC_PENDING - 1);
+    if (head == pending_tail)
+    {
+        pending_overruns++;
+        return;
+    }
+    for (ch = 0; ch < ADC_CHANNELS; ch++)
+        pending[pending_head][ch] = cic_comb(&cic[ch], decim_log2);
+    pending_head = head;
+
+    // The pipeline (FIR, integrator, estimators) can take longer than one
+    // ADC period at 8x, so it runs with interrupts enabled. A nested entry
+    // only integrates and queues; the outer one drains the queue.
+    if (pipeline_busy) return;
+    pipeline_busy = 1;
+    do {
+        // copied out: the slot is free for nested entries once the tail moves
+        int16_t v[ADC_CHANNELS];
+        memcpy(v, pending[pending_tail], sizeof(v));
+        pending_tail = (pending_tail + 1) & (ADC_PENDING - 1);
+        sei();
+        adc_process(v);
+        cli();
+    } while (pending_tail != pending_head);
+    pipeline_busy = 0;
+}
+
+uint8_t adc_block_ready(void)
+{
+    return blocks_ready != 0;
+}
+
+dsp_window_t *adc_wait_block(void)
+{
+    while (!blocks_ready) { }
+    return &window;
+}
+
+void adc_release_block(void)
+{
+    blocks_ready = 0;
+}
+
+uint16_t adc_dropped_blocks(void)
+{
+    uint16_t n;
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        n = dropped_blocks + pending_overruns;
+    }
+    return n;
+}
+
+void adc_set_window(uint8_t count)
+{
+    window_len = count;
+}
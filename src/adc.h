@@ -0,0 +1,43 @@
+#ifndef ADC_H
+#define ADC_H
+
+#include <stdint.h>
+#include "dsp.h"
+
+#define SAMPLE_COUNT  100   // samples per window (default)
+
+// --- Oversampling: ADC at 2^log2r x the sample rate, CIC decimated (cic.h) ---
+// With ADC_CHANNELS inputs (timer.h) the mux steps through ADC0 .. ADC_CHANNELS-1
+// once per oversampled tick, so the ADC runs ADC_CHANNELS x 2^log2r x the
+// sample rate and the ratio has to come down: 2x for 3 or 4 inputs at 1 kHz.
+#define ADC_DECIM_LOG2_DEFAULT (ADC_CHANNELS == 1 ? 3 : ADC_CHANNELS == 2 ? 2 : 1)
+#define ADC_DECIM_LOG2_MAX     3   // 8x; the ADC rate limit may allow less (config_decimation())
+#define ADC_RATE_MAX_HZ        9600   // highest ADC trigger rate, channels x sample rate << log2r
+#define ADC_RATE_MARGIN        150    // headroom needed to step the ratio back up, Hz: a locked
+                                      // rate hovering at the limit (60 Hz x 20 x 8) keeps its ratio
+#define ADC_CENTER_DEFAULT     512    // mid-scale, until calibrated
+#define ADC_PENDING            4   // decimated sample sets queued for the pipeline, power of 2
+
+void adc_init(void);
+
+/* Continuous capture: the ADC ISR streams every sample through the DSP
+   pipeline, which keeps the open window's sums itself, and every
+   SAMPLE_COUNT samples stores the results in the one block for the main
+   loop. A window that closes while the main loop still holds the block is
+   counted as dropped. */
+uint8_t adc_block_ready(void);       // a window is waiting for the main loop
+dsp_window_t *adc_wait_block(void);  // blocks until a window is ready
+void adc_release_block(void);        // hand the block back to the ISR
+uint16_t adc_dropped_blocks(void);   // dropped windows plus lost decimated samples
+
+/* Samples per window, takes effect at the next window boundary */
+void adc_set_window(uint8_t count);
+
+/* Decimation ratio 2^log2r (0..ADC_DECIM_LOG2_MAX); also retunes Timer1 */
+void adc_set_decimation(uint8_t log2r);
+uint8_t adc_decimation(void);
+
+/* Coarse offset subtracted from every conversion, ADC LSB, all channels */
+void adc_set_center(uint16_t center);
+
+#endif
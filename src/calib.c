@@ -0,0 +1,100 @@
+#include <avr/eeprom.h>
+#include <util/crc16.h>
+#include "calib.h"
+#include "adc.h"
+#include "dsp.h"
+#include "rms.h"
+
+static calib_t EEMEM stored;
+static calib_t cal;
+
+static uint16_t calib_crc(const calib_t *c)
+{
+    const uint8_t *p = (const uint8_t *)c;
+    uint16_t crc = 0xFFFF;
+
+    for (uint8_t i = 0; i < sizeof(calib_t) - sizeof(c->crc); i++)
+        crc = _crc_xmodem_update(crc, p[i]);
+    return crc;
+}
+
+static void calib_apply(void)
+{
+    adc_set_center(cal.center);
+    rms_set_gain(cal.gain);
+    dsp_set_phase(cal.phase);
+}
+
+void calib_load(void)
+{
+    eeprom_read_block(&cal, &stored, sizeof(cal));
+    if (cal.version != CALIB_VERSION || cal.crc != calib_crc(&cal))
+    {
+        cal.version = CALIB_VERSION;
+        cal.center = ADC_CENTER_DEFAULT;
+        cal.gain = CALIB_GAIN_ONE;
+        cal.phase = 0;
+    }
+    calib_apply();
+}
+
+void calib_init(void)
+{
+    calib_load();
+}
+
+void calib_save(void)
+{
+    cal.crc = calib_crc(&cal);
+    eeprom_update_block(&cal, &stored, sizeof(cal));   // only changed bytes are written
+}
+
+const calib_t *calib(void)
+{
+    return &cal;
+}
+
+void calib_set_center(uint16_t center)
+{
+    cal.center = center;
+    adc_set_center(center);
+}
+
+void calib_set_gain(uint16_t gain)
+{
+    if (gain < CALIB_GAIN_MIN) gain = CALIB_GAIN_MIN;
+    if (gain > CALIB_GAIN_MAX) gain = CALIB_GAIN_MAX;
+    cal.gain = gain;
+    rms_set_gain(gain);
+}
+
+void calib_set_phase(uint8_t phase)
+{
+    cal.phase = phase;
+    dsp_set_phase(phase);
+}
+
+uint16_t calib_zero(void)
+{
+    // dc is in 1/4 LSB; move whole LSBs to the ADC and take them off the estimate
+    int16_t dc = dsp_dc();
+    int16_t lsb = (dc + (dc < 0 ? -(1 << DSP_IN_FRAC_BITS) / 2 : (1 << DSP_IN_FRAC_BITS) / 2))
+                  / (1 << DSP_IN_FRAC_BITS);
+
+    if (lsb)
+    {
+        calib_set_center(cal.center + lsb);
+        dsp_shift_dc(-lsb * (1 << DSP_IN_FRAC_BITS));
+    }
+    return cal.center;
+}
+
+uint16_t calib_reference(uint16_t ref)
+{
+    uint16_t measured = rms_aggregate(RMS_LEVEL_1S)->rms_mean;
+    if (!measured || !ref) return cal.gain;
+
+    uint32_t gain = ((uint32_t)cal.gain * ref + measured / 2) / measured;
+    calib_set_gain(gain > 0xFFFF ? 0xFFFF : gain);   // clamped to the gain range
+    return cal.gain;
+}
@@ -0,0 +1,46 @@
+#ifndef CALIB_H
+#define CALIB_H
+
+#include <stdint.h>
+
+/* Per-unit calibration, kept in EEPROM with a CRC and applied at start-up:
+   - center: coarse ADC offset subtracted in the ADC ISR; the DSP removes
+     what is left with its running DC estimate (dsp.h)
+   - gain:   Q14 correction of every 0.01 mA value (rms.h)
+   - phase:  input delay in 1/256 sample (dsp.h)
+   Changed at runtime through the config channel (config.h); calib_save()
+   makes the current values permanent. */
+#define CALIB_VERSION   1
+#define CALIB_GAIN_ONE  16384    // Q14 1.0
+#define CALIB_GAIN_MIN  4096     // 0.25, lowest gain calib_set_gain() accepts
+#define CALIB_GAIN_MAX  32768    // 2.0, highest
+
+typedef struct
+{
+    uint8_t  version;
+    uint16_t center;
+    uint16_t gain;
+    uint8_t  phase;
+    uint16_t crc;           // CRC-16/CCITT-FALSE over the fields above
+} calib_t;
+
+/* Load from EEPROM, or the defaults if it holds no valid record, and apply */
+void calib_init(void);
+const calib_t *calib(void);
+
+void calib_set_center(uint16_t center);
+void calib_set_gain(uint16_t gain);
+void calib_set_phase(uint8_t phase);
+
+/* With no current flowing: fold the tracked DC offset into center.
+   Returns the new center. */
+uint16_t calib_zero(void);
+
+/* With a known current flowing: scale the gain so the last 1 s RMS reads
+   ref (0.01 mA). Returns the new gain, unchanged if nothing was measured. */
+uint16_t calib_reference(uint16_t ref);
+
+void calib_save(void);
+void calib_load(void);
+
+#endif
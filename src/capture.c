@@ -0,0 +1,141 @@
+#include <util/atomic.h>
+#include "capture.h"
+
+#define CAPTURE_ARMED    0
+#define CAPTURE_POSTTRIG 1
+#define CAPTURE_FROZEN   2
+
+static int16_t ring[CAPTURE_LEN];
+static uint8_t head;                 // next write, oldest sample once full
+static uint8_t filled;               // pre-trigger history collected so far
+static uint8_t remaining;            // post-trigger samples still to take
+static volatile uint8_t state;
+static volatile uint8_t pending;     // trigger raised by the main loop
+static uint8_t source;
+static uint8_t event;
+static uint16_t last_rms;
+static uint8_t primed;               // last_rms holds a window to step from
+
+static capture_config_t cfg = {
+    CAPTURE_SRC_LEVEL | CAPTURE_SRC_SLOPE | CAPTURE_SRC_RMS,
+    11800,   // ~3.1 A
+    1770,    // near full scale of the filtered signal
+    5000     // 50 mA step
+};
+
+static inline uint16_t abs16(int16_t v)
+{
+    return (v < 0) ? -(uint16_t)v : (uint16_t)v;
+}
+
+void capture_init(void)
+{
+    head = 0;
+    filled = 0;
+    pending = 0;
+    state = CAPTURE_ARMED;
+}
+
+void capture_configure(const capture_config_t *c)
+{
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        // RMS triggering switched on steps from its next window, not an old one
+        if ((c->sources & ~cfg.sources) & CAPTURE_SRC_RMS)
+            primed = 0;
+        cfg = *c;
+    }
+}
+
+const capture_config_t *capture_config(void)
+{
+    return &cfg;
+}
+
+void capture_push(int16_t current, int16_t slope)
+{
+    uint8_t st = state;
+    if (st == CAPTURE_FROZEN) return;
+
+    ring[head] = current;
+    if (++head >= CAPTURE_LEN) head = 0;
+
+    if (st == CAPTURE_ARMED)
+    {
+        if (filled < CAPTURE_PRE)
+        {
+            filled++;
+            return;
+        }
+
+        uint8_t src = pending;
+        if ((cfg.sources & CAPTURE_SRC_LEVEL) && abs16(current) > cfg.level)
+            src |= CAPTURE_SRC_LEVEL;
+        if ((cfg.sources & CAPTURE_SRC_SLOPE) && abs16(slope) > cfg.slope)
+            src |= CAPTURE_SRC_SLOPE;
+        if (!src) return;
+
+        pending = 0;
+        source = src;
+        remaining = CAPTURE_POST - 1;   // the trigger sample is the first one
+        st = CAPTURE_POSTTRIG;
+    }
+    else if (remaining)
+    {
+        remaining--;
+    }
+
+    if (st == CAPTURE_POSTTRIG && !remaining)
+    {
+        event++;
+        st = CAPTURE_FROZEN;
+    }
+    state = st;
+}
+
+void capture_rms(uint16_t rms)
+{
+    uint16_t step = (rms > last_rms) ? rms - last_rms : last_rms - rms;
+    last_rms = rms;
+    if (!primed)
+    {
+        primed = 1;   // the first window only seeds last_rms
+        return;
+    }
+
+    if ((cfg.sources & CAPTURE_SRC_RMS) && step > cfg.rms_step && state == CAPTURE_ARMED)
+        pending = CAPTURE_SRC_RMS;
+}
+
+uint8_t capture_ready(void)
+{
+    return state == CAPTURE_FROZEN;
+}
+
+uint8_t capture_event(void)
+{
+    return event;
+}
+
+uint8_t capture_source(void)
+{
+    return source;
+}
+
+int16_t capture_sample(uint8_t i)
+{
+    // ring is full and frozen: the oldest sample sits at head
+    uint8_t idx = head + i;
+    if (idx >= CAPTURE_LEN) idx -= CAPTURE_LEN;
+    return ring[idx];
+}
+
+void capture_rearm(void)
+{
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        filled = 0;
+        pending = 0;
+        state = CAPTURE_ARMED;
+    }
+}
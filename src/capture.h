@@ -0,0 +1,45 @@
+#ifndef CAPTURE_H
+#define CAPTURE_H
+
+#include <stdint.h>
+
+// --- Snapshot geometry, in decimated samples of the integrated current ---
+#define CAPTURE_PRE    32
+#define CAPTURE_POST   64
+#define CAPTURE_LEN    (CAPTURE_PRE + CAPTURE_POST)
+#define CAPTURE_CHUNK  12                          // samples per SPI frame
+#define CAPTURE_CHUNKS (CAPTURE_LEN / CAPTURE_CHUNK)
+
+// --- Trigger sources ---
+#define CAPTURE_SRC_LEVEL 0x01   // |current| above level
+#define CAPTURE_SRC_SLOPE 0x02   // |di/dt| (the filtered coil signal) above slope
+#define CAPTURE_SRC_RMS   0x04   // window RMS changed by more than rms_step
+
+typedef struct {
+    uint8_t  sources;    // enabled trigger sources
+    uint16_t level;      // integrated LSB
+    uint16_t slope;      // filtered LSB
+    uint16_t rms_step;   // 0.01 mA
+} capture_config_t;
+
+void capture_init(void);
+void capture_configure(const capture_config_t *cfg);
+const capture_config_t *capture_config(void);
+
+/* ADC ISR, every sample: keeps the pre-trigger ring running, checks the
+   sample triggers and freezes the snapshot after CAPTURE_POST samples */
+void capture_push(int16_t current, int16_t slope);
+
+/* Main loop, every window: RMS step trigger */
+void capture_rms(uint16_t rms);
+
+/* Frozen snapshot: CAPTURE_PRE samples before the trigger, the trigger
+   sample at index CAPTURE_PRE, then the post-trigger samples. It stays
+   frozen, while measurement carries on, until capture_rearm(). */
+uint8_t capture_ready(void);
+uint8_t capture_event(void);     // increments for every snapshot
+uint8_t capture_source(void);    // CAPTURE_SRC_* that fired
+int16_t capture_sample(uint8_t i);
+void capture_rearm(void);
+
+#endif
@@ -0,0 +1,157 @@
+#include "config.h"
+#include "spi.h"
+#include "adc.h"
+#include "rms.h"
+#include "timer.h"
+#include "wave.h"
+#include "capture.h"
+#include "calib.h"
+#include "fir.h"
+#include "freq.h"
+
+config_t config = {
+    SAMPLE_RATE_HZ,
+    SAMPLE_COUNT,
+    ADC_DECIM_LOG2_DEFAULT,
+    1,
+    SPI_BATCH_WINDOWS,
+    VIEW_NUMBERS,
+    WAVE_SOURCE_DEFAULT,
+    WAVE_DELTA_DEFAULT
+};
+
+static uint16_t clamp16(uint16_t v, uint16_t lo, uint16_t hi)
+{
+    return (v < lo) ? lo : (v > hi) ? hi : v;
+}
+
+uint8_t config_decimation(uint16_t ticks)
+{
+    uint8_t log2r = config.decimation;
+    uint8_t now = adc_decimation();
+
+    // ADC rate F_CPU / ticks x channels << log2r against the limit, which is
+    // ADC_RATE_MARGIN lower for a step up from the ratio in effect
+    while (log2r && ((F_CPU * ADC_CHANNELS) << log2r)
+                    > (uint32_t)(log2r > now ? ADC_RATE_MAX_HZ - ADC_RATE_MARGIN : ADC_RATE_MAX_HZ) * ticks)
+        log2r--;
+    return log2r;
+}
+
+// Apply one setting, *value becomes the value in effect; 0 for an unknown key
+static uint8_t config_set(uint8_t key, uint16_t *value)
+{
+    uint16_t v = *value;
+    capture_config_t cap = *capture_config();
+
+    switch (key)
+    {
+    case CFG_SAMPLE_RATE:
+        v = clamp16(v, CONFIG_RATE_MIN, CONFIG_RATE_MAX);
+        config.sample_rate = v;
+        break;
+    case CFG_WINDOW:
+        v = clamp16(v, CONFIG_WINDOW_MIN, CONFIG_WINDOW_MAX);
+        config.window = v;
+        break;
+    case CFG_DECIMATION:
+        // applied with the sample period, by the main loop's sync_update()
+        config.decimation = clamp16(v, 0, ADC_DECIM_LOG2_MAX);
+        v = config_decimation(timer1_period());
+        break;
+    case CFG_SYNC:
+        v = config.sync = (v != 0);
+        break;
+    case CFG_BATCH:
+        v = config.batch = clamp16(v, 1, CONFIG_BATCH_MAX);
+        break;
+    case CFG_VIEW:
+        v = config.view = clamp16(v, 0, VIEW_COUNT - 1);
+        break;
+    case CFG_WAVE_SOURCE:
+        v = config.wave_source = clamp16(v, WAVE_SRC_OFF, WAVE_SRC_CURRENT);
+        wave_configure(config.wave_source, config.wave_delta);
+        break;
+    case CFG_WAVE_DELTA:
+        v = config.wave_delta = (v != 0);
+        wave_configure(config.wave_source, config.wave_delta);
+        break;
+    case CFG_CAPTURE_SOURCES:
+        v = cap.sources = v & (CAPTURE_SRC_LEVEL | CAPTURE_SRC_SLOPE | CAPTURE_SRC_RMS);
+        capture_configure(&cap);
+        break;
+    case CFG_CAPTURE_LEVEL:
+        cap.level = v;
+        capture_configure(&cap);
+        break;
+    case CFG_CAPTURE_SLOPE:
+        cap.slope = v;
+        capture_configure(&cap);
+        break;
+    case CFG_CAPTURE_STEP:
+        cap.rms_step = v;
+        capture_configure(&cap);
+        break;
+    case CFG_CAL_CENTER:
+        v = clamp16(v, 0, 1023);
+        calib_set_center(v);
+        break;
+    case CFG_CAL_GAIN:
+        if (v) calib_set_gain(v);   // 0 would zero every reading: keep the current gain
+        v = calib()->gain;
+        break;
+    case CFG_CAL_PHASE:
+        v = clamp16(v, 0, 255);
+        calib_set_phase(v);
+        break;
+    case CFG_CAL_ZERO:
+        v = calib_zero();
+        break;
+    case CFG_CAL_REFERENCE:
+        v = calib_reference(v);
+        break;
+    case CFG_CAL_SAVE:
+        v = (v != 0);
+        if (v)
+            calib_save();
+        else
+            calib_load();
+        break;
+    case CFG_FIR_PROFILE:
+        if (v < FIR_PROFILE_COUNT)
+            fir_set_profile(v);
+        v = fir_profile();
+        break;
+    case CFG_FREQ_CYCLES:
+        v = clamp16(v, 1, CONFIG_CYCLES_MAX);
+        freq_set_cycles(v);
+        break;
+    default:
+        return 0;
+    }
+
+    *value = v;
+    return 1;
+}
+
+void config_apply(const uint8_t *packet)
+{
+    uint8_t keys[SPI_CMD_MAX];
+    uint16_t values[SPI_CMD_MAX];
+    uint8_t n = packet[3];
+    const uint8_t *p = packet + SPI_CMD_HEAD;
+
+    for (uint8_t i = 0; i < n; i++, p += 3)
+    {
+        keys[i] = p[0];
+        values[i] = (p[1] << 8) | p[2];
+        if (!config_set(keys[i], &values[i]))
+            keys[i] |= CFG_REJECTED;
+    }
+    spi_add_config(packet[2], n, keys, values);
+}
+
+uint16_t config_ticks(void)
+{
+    return F_CPU / config.sample_rate;
+}
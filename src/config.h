@@ -0,0 +1,69 @@
+#ifndef CONFIG_H
+#define CONFIG_H
+
+#include <stdint.h>
+
+/* Runtime settings, sent by the ESP over the SPI downlink (spi.h). Each
+   command packet carries [key, value] pairs; every pair is clamped to its
+   range, applied, and echoed back with the value actually in effect in an
+   SPI_REC_CONFIG record. Unknown keys come back with CFG_REJECTED set. */
+#define CFG_SAMPLE_RATE     0x01   // Hz, when not locked to the mains
+#define CFG_WINDOW          0x02   // samples per window, when not locked
+#define CFG_DECIMATION      0x03   // log2 oversampling, limited by ADC_RATE_MAX_HZ
+#define CFG_SYNC            0x04   // mains-synchronous window on / off
+#define CFG_BATCH           0x05   // windows per SPI frame
+#define CFG_VIEW            0x06   // display view
+#define CFG_WAVE_SOURCE     0x07   // WAVE_SRC_*
+#define CFG_WAVE_DELTA      0x08
+#define CFG_CAPTURE_SOURCES 0x09   // CAPTURE_SRC_* mask
+#define CFG_CAPTURE_LEVEL   0x0A   // integrated LSB
+#define CFG_CAPTURE_SLOPE   0x0B   // filtered LSB
+#define CFG_CAPTURE_STEP    0x0C   // 0.01 mA
+#define CFG_CAL_CENTER      0x0D   // coarse ADC offset, LSB
+#define CFG_CAL_GAIN        0x0E   // Q14, CALIB_GAIN_MIN .. MAX; 0 is ignored
+#define CFG_CAL_PHASE       0x0F   // 1/256 sample
+#define CFG_CAL_ZERO        0x10   // no current flowing: echoes the new center
+#define CFG_CAL_REFERENCE   0x11   // known current flowing, 0.01 mA: echoes the new gain
+#define CFG_CAL_SAVE        0x12   // 1 stores the calibration in EEPROM, 0 reloads it
+#define CFG_FIR_PROFILE     0x13   // FIR_PROFILE_* (fir_coeffs.h), out of range keeps the current one
+#define CFG_FREQ_CYCLES     0x14   // mains periods averaged per frequency estimate
+#define CFG_REJECTED        0x80
+
+#define CONFIG_RATE_MIN     250     // Timer1 period must fit 16 bits
+#define CONFIG_RATE_MAX     2000    // x ADC_CHANNELS_MAX still within ADC_RATE_MAX_HZ at 1x
+#define CONFIG_WINDOW_MIN   10
+#define CONFIG_WINDOW_MAX   250
+#define CONFIG_BATCH_MAX    8
+#define CONFIG_CYCLES_MAX   50      // 1 s at 50 Hz between estimates
+
+// --- Display views ---
+#define VIEW_NUMBERS 0      // peak / RMS / frequency
+#define VIEW_SCOPE   1      // waveform of the integrated current
+#define VIEW_TREND   2      // scrolling window RMS
+#define VIEW_COUNT   3
+
+typedef struct
+{
+    uint16_t sample_rate;
+    uint8_t  window;
+    uint8_t  decimation;    // requested, the ADC may run lower
+    uint8_t  sync;
+    uint8_t  batch;
+    uint8_t  view;
+    uint8_t  wave_source;
+    uint8_t  wave_delta;
+} config_t;
+
+extern config_t config;
+
+/* Apply a command packet from spi_command() and queue the acknowledgement */
+void config_apply(const uint8_t *packet);
+
+/* Timer1 period of the configured sample rate */
+uint16_t config_ticks(void);
+
+/* Decimation (log2) to run at a sample period of ticks: the configured
+   ratio, lowered until the ADC keeps up with every input at that rate */
+uint8_t config_decimation(uint16_t ticks);
+
+#endif
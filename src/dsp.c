@@ -0,0 +1,149 @@
+#include <util/atomic.h>
+#include "dsp.h"
+#include "fir.h"
+#include "freq.h"
+#include "capture.h"
+#include "scope.h"
+#include "wave.h"
+#include "timer.h"
+
+/* Per-input state: every channel is filtered and integrated on its own */
+typedef struct {
+    fir_state_t fir;
+    int32_t y_acc;          // integrator, 32-bit accumulator
+    int32_t dc_acc;         // DC estimate << DSP_DC_SHIFT
+    uint16_t dc_frac;       // fraction carried between samples
+    int16_t x_prev;         // for the fractional delay
+} dsp_channel_t;
+
+static dsp_channel_t chan[ADC_CHANNELS];
+static dsp_sums_t sums[ADC_CHANNELS];   // open window
+static uint8_t count;
+static uint8_t phase;       // delay in 1/256 sample, 0 = none
+static int16_t dt_scaled = DSP_DT_SCALED;
+static uint32_t sample_clock;   // decimated samples since reset
+
+void dsp_init(void)
+{
+    for (uint8_t ch = 0; ch < ADC_CHANNELS; ch++)
+        fir_init(&chan[ch].fir);
+    freq_init();
+    capture_init();
+}
+
+// One sample of one channel into its window sums; *x becomes the delayed
+// input and *filtered the FIR output, the integrated value is returned
+static inline int16_t dsp_channel(dsp_channel_t *c, dsp_sums_t *s, int16_t *x, int16_t *filtered)
+{
+    // Fractional delay: (1 - p) x[n] + p x[n-1]
+    int16_t in = *x;
+    int16_t d = in - c->x_prev;
+    c->x_prev = in;
+    if (phase)
+        in -= (int16_t)(((int32_t)d * phase) >> 8);
+    *x = in;
+
+    int16_t f = fir_process(&c->fir, in);
+
+    // Track and remove the DC offset: dc += (filtered - dc) / 2^DSP_DC_SHIFT.
+    // Done after the FIR so its rounding bias goes too, and with the fraction
+    // of dc carried over, so the integrator sees an exactly zero-mean input.
+    int32_t dc = c->dc_acc + c->dc_frac;
+    c->dc_frac = (uint16_t)dc & ((1 << DSP_DC_SHIFT) - 1);
+    f -= (int16_t)(dc >> DSP_DC_SHIFT);
+    c->dc_acc += f;
+    *filtered = f;
+
+    // Leaky fixed-point integration: y[n] = y[n-1] - y[n-1]/2^k + x[n]*dt_scaled
+    c->y_acc -= c->y_acc >> DSP_LEAK_SHIFT;
+    c->y_acc += (int32_t)f * dt_scaled;
+    int16_t y = (int16_t)(c->y_acc >> (DSP_DT_SHIFT + DSP_IN_FRAC_BITS));
+    uint16_t val = (y < 0) ? -(uint16_t)y : (uint16_t)y;  // absolute value, -32768 safe
+
+    if (val > s->peak) s->peak = val;
+    s->sum_sq += (uint32_t)val * val;
+    return y;
+}
+
+void dsp_push(const int16_t *x)
+{
+    int16_t in = x[0], filtered;
+    int16_t y = dsp_channel(&chan[0], &sums[0], &in, &filtered);
+
+    harm_push(y);
+    capture_push(y, filtered);
+    scope_push(y);
+    wave_push(in, filtered, y);
+
+    freq_push(filtered);
+
+    // the other inputs only need their window sums
+    for (uint8_t ch = 1; ch < ADC_CHANNELS; ch++)
+    {
+        in = x[ch];
+        dsp_channel(&chan[ch], &sums[ch], &in, &filtered);
+    }
+
+    count++;
+    sample_clock++;
+}
+
+void dsp_set_period(uint16_t ticks)
+{
+    int16_t dt = (int16_t)(((uint32_t)DSP_DT_SCALED * ticks + TIMER1_TICKS_NOMINAL / 2)
+                           / TIMER1_TICKS_NOMINAL);
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        dt_scaled = dt;
+    }
+}
+
+void dsp_set_phase(uint8_t p)
+{
+    phase = p;
+}
+
+// The estimate is taken after the FIR, so it carries the profile's DC gain;
+// a high- or band-pass profile hides the offset and reports none
+#define DC_GAIN_MIN 8192    // Q15, 1/4
+
+int16_t dsp_dc(void)
+{
+    uint16_t gain = fir_dc_gain();
+    int32_t dc;
+    if (gain < DC_GAIN_MIN) return 0;
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        dc = chan[0].dc_acc;
+    }
+    return (int16_t)(((dc >> DSP_DC_SHIFT) << 15) / gain);
+}
+
+void dsp_shift_dc(int16_t step)
+{
+    int32_t d = ((int32_t)step * fir_dc_gain()) >> (15 - DSP_DC_SHIFT);
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        for (uint8_t ch = 0; ch < ADC_CHANNELS; ch++)
+            chan[ch].dc_acc += d;
+    }
+}
+
+void dsp_close_window(dsp_window_t *out)
+{
+    for (uint8_t ch = 0; ch < ADC_CHANNELS; ch++)
+    {
+        if (out) out->ch[ch] = sums[ch];
+        sums[ch].peak = 0;
+        sums[ch].sum_sq = 0;
+    }
+    if (out)
+    {
+        out->count = count;
+        out->stamp = sample_clock;
+    }
+    harm_close_window(out ? &out->harm : 0);
+
+    count = 0;
+    // the integrators carry on: the leak bounds drift, a reset here would step the waveform
+}
@@ -0,0 +1,69 @@
+#ifndef DSP_H
+#define DSP_H
+
+#include <stdint.h>
+#include "harm.h"
+#include "timer.h"
+
+// --- Fixed-point integration scaling ---
+#define DSP_DT_SCALED 327   // integration increment scaling at SAMPLE_RATE_HZ
+#define DSP_DT_SHIFT  10    // right shift to fit int16_t safely
+#define DSP_IN_FRAC_BITS 2  // input samples are ADC LSB << 2 (CIC_OUT_FRAC_BITS)
+
+// --- Drift control ---
+// Running DC estimate, a one-pole low-pass of the FIR output removed before
+// the integrator: time constant 2^DSP_DC_SHIFT samples (~1 s at 1 kHz).
+#define DSP_DC_SHIFT   10
+// Leaky integrator, y[n] = y[n-1] - y[n-1] / 2^DSP_LEAK_SHIFT + x[n] * dt:
+// corner ~fs / (2 pi 2^DSP_LEAK_SHIFT), 0.16 Hz at 1 kHz, so residual offset
+// settles instead of ramping. Together with the DC estimate the phase
+// error at 50 Hz stays under 0.4 degrees.
+#define DSP_LEAK_SHIFT 10
+
+/* Peak and energy of one input over a window */
+typedef struct {
+    uint16_t peak;        // max |integrated|
+    uint64_t sum_sq;      // sum of integrated^2, cannot overflow for any window
+} dsp_sums_t;
+
+/* Running results of one window, folded in sample by sample */
+typedef struct {
+    dsp_sums_t ch[ADC_CHANNELS];
+    uint8_t  count;       // samples in the window
+    uint32_t stamp;       // sample clock at the end of the window
+    harm_window_t harm;   // Goertzel bank state at the end of the window, channel 0
+} dsp_window_t;
+
+void dsp_init(void);
+
+/* Streaming pipeline, called from the ADC ISR with one decimated sample per
+   channel (centered, DSP_IN_FRAC_BITS fractional bits). Every channel has
+   its own state and runs
+   fractional delay -> FIR -> DC removal -> leaky integrate -> peak / sum of squares;
+   channel 0 also feeds the harmonics, frequency estimator, capture, scope
+   and waveform stream.
+
+   Cycle budget per sample period: ~500 cycles per channel plus ~800 for
+   the channel 0 extras, 2.8k cycles for four channels. At the 2 kHz top
+   rate that is 35 % of the 8k cycle period, leaving the rest for the ADC
+   ISR (4 channels x 2^log2r conversions at ~100 cycles) and the main loop. */
+void dsp_push(const int16_t *x);
+
+/* Integration step for a sample period of ticks CPU clocks, so the
+   integrated current does not depend on the sample rate */
+void dsp_set_period(uint16_t ticks);
+
+/* Fractional delay of the inputs, phase in 1/256 sample, by linear
+   interpolation with the previous sample (calib.h) */
+void dsp_set_phase(uint8_t phase);
+
+/* Running DC estimate of channel 0 in input units (1/4 ADC LSB), and a
+   step applied to every channel when the shared coarse ADC offset moves by
+   the same amount */
+int16_t dsp_dc(void);
+void dsp_shift_dc(int16_t step);
+
+/* Copy the running results to *out (NULL drops them) and start a new window */
+void dsp_close_window(dsp_window_t *out);
+
+#endif
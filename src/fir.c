@@ -1,38 +1,122 @@
+#include <string.h>
+#include <avr/pgmspace.h>
 #include "fir.h"
 
-int16_t fir_buffer[FIR_TAPS] = {0}; 
+// acc += a * b, signed 16x16 -> 32
+static inline int32_t fir_mac(int32_t acc, int16_t a, int16_t b)
+{
+#if defined(__AVR_HAVE_MUL__)
+    // AVR201 style MAC: 4 hardware multiplies, ~20 cycles instead of a
+    // __mulsi3 call. mulsu needs its operands in r16..r23 ("a").
+    uint8_t zero;
+    __asm__ (
+        "clr   %[z]            \n\t"
+        "muls  %B[a], %B[b]    \n\t"   // ah * bh
+        "add   %C[acc], r0     \n\t"
+        "adc   %D[acc], r1     \n\t"
+        "mul   %A[a], %A[b]    \n\t"   // al * bl
+        "add   %A[acc], r0     \n\t"
+        "adc   %B[acc], r1     \n\t"
+        "adc   %C[acc], %[z]   \n\t"
+        "adc   %D[acc], %[z]   \n\t"
+        "mulsu %B[a], %A[b]    \n\t"   // ah * bl
+        "sbc   %D[acc], %[z]   \n\t"
+        "add   %B[acc], r0     \n\t"
+        "adc   %C[acc], r1     \n\t"
+        "adc   %D[acc], %[z]   \n\t"
+        "mulsu %B[b], %A[a]    \n\t"   // bh * al
+        "sbc   %D[acc], %[z]   \n\t"
+        "add   %B[acc], r0     \n\t"
+        "adc   %C[acc], r1     \n\t"
+        "adc   %D[acc], %[z]   \n\t"
+        "clr   __zero_reg__    \n\t"
+        : [acc] "+r" (acc), [z] "=&r" (zero)
+        : [a] "a" (a), [b] "a" (b)
+        : "r0");
+    return acc;
+#else
+    return acc + (int32_t)a * b;
+#endif
+}
 
-// Q15 scaled symmetric coefficients (32 coefficients)
-const int16_t fir_coeff[FIR_TAPS] = {
-  -56, 64, -78, 86, -68, 0, 143, -377, 710, -1128,
-  1605, -2105, 2573, -2952, 29530, 29530, -2952, 2573,
-  -2105, 1605, -1128, 710, -377, 143, 0, -68, 86, -78,
-  64, -56, 0, 0 
-};
+static inline int16_t fir_q15(int32_t acc)
+{
+    // Convert back to Q15
+    acc = acc >> 15;
 
+    // Saturation
+    if (acc > 32767) acc = 32767;
+    if (acc < -32768) acc = -32768;
 
-//  FIR filter function
-fir_process(int16_t input)
+    return (int16_t)acc;
+}
+
+// One kernel per profile, unrolled by the generator: x[0] is the newest
+// sample, and the symmetric kernel is folded, h[i] * (x[n-i] + x[n-(N-1-i)])
+#define FIR_PAIR(i, j, c)   acc = fir_mac(acc, c, x[i] + x[j]);
+#define FIR_CENTER(i, c)    acc = fir_mac(acc, c, x[i]);
+#define FIR_KERNEL(NAME, name)                      \
+    static int16_t fir_##name(const int16_t *x)     \
+    {                                               \
+        int32_t acc = 0;                            \
+        FIR_##NAME##_KERNEL                         \
+        return fir_q15(acc);                        \
+    }
+FIR_PROFILES(FIR_KERNEL)
+
+#define FIR_ENTRY(NAME, name) { FIR_##NAME##_TAPS, FIR_##NAME##_DC_GAIN },
+static const struct {
+    uint8_t taps;
+    uint16_t dc_gain;
+} profiles[FIR_PROFILE_COUNT] PROGMEM = { FIR_PROFILES(FIR_ENTRY) };
+
+static uint8_t profile = FIR_PROFILE_DEFAULT;   // one byte, read by the ISR as is
+
+#define FIR_CASE(NAME, name) case FIR_PROFILE_##NAME: return fir_##name(x);
+
+void fir_init(fir_state_t *f)
 {
-    uint8_t fir_index = 0;
-    fir_buffer[fir_index] = input;
-    int32_t acc = 0;
+    memset(f, 0, sizeof(*f));
+}
 
-    for (uint8_t i = 0; i < FIR_TAPS / 2; i++)
+//  FIR filter function, one sample; the delay line carries over between calls
+int16_t fir_process(fir_state_t *f, int16_t input)
+{
+    if (!f->pos)
     {
-        uint8_t a_idx = (fir_index + i) % FIR_TAPS;
-        uint8_t b_idx = (fir_index + FIR_TAPS - 1 - i) % FIR_TAPS;
-        acc += (int32_t)fir_coeff[i] * (fir_buffer[a_idx] + fir_buffer[b_idx]);
+        // bottom reached: the newest FIR_TAPS - 1 samples become the oldest
+        memmove(&f->hist[FIR_SLACK + 1], f->hist, (FIR_TAPS - 1) * sizeof(f->hist[0]));
+        f->pos = FIR_SLACK + 1;
     }
 
-    fir_index = (fir_index + 1) % FIR_TAPS;
+    int16_t *x = &f->hist[--f->pos];
+    x[0] = input;
 
-    // Convert back to Q15
-    acc = acc >> 15;
+    // each kernel inlines into its case, no indirect call per sample
+    switch (profile)
+    {
+    FIR_PROFILES(FIR_CASE)
+    }
+    return 0;   // not reached, fir_set_profile() keeps profile valid
+}
 
-    // Saturation
-    if (acc > 32767) acc = 32767;
-    if (acc < -32768) acc = -32768;
+void fir_set_profile(uint8_t p)
+{
+    if (p < FIR_PROFILE_COUNT)
+        profile = p;
+}
 
-    return (int16_t)acc;
-}
\ No newline at end of file
+uint8_t fir_profile(void)
+{
+    return profile;
+}
+
+uint8_t fir_taps(void)
+{
+    return pgm_read_byte(&profiles[profile].taps);
+}
+
+uint16_t fir_dc_gain(void)
+{
+    return pgm_read_word(&profiles[profile].dc_gain);
+}
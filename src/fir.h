@@ -2,11 +2,40 @@
 #define _FIR_H
 
 #include <stdint.h>
+#include "fir_coeffs.h"
 
 
-#define FIR_TAPS 32
+/* Profiles: Q15 symmetric kernels designed by tools/fir_design.py from
+   tools/fir_profiles.txt (make regenerates fir_coeffs.h). Each is compiled
+   to straight-line code, coefficients as immediates, so a profile costs
+   its own ceil(taps / 2) multiplies per sample and no more. Low-pass
+   profiles have unity DC gain. */
+#define FIR_TAPS FIR_TAPS_MAX   // delay line, long enough for every profile
+#define FIR_SLACK 2             // spare delay-line slots, one move every FIR_SLACK + 1 samples
+#define FIR_PROFILE_DEFAULT 0
 
+/* Filter state. New samples are written downwards from the top of the
+   delay line, so the last FIR_TAPS samples are always contiguous, newest
+   first, and the kernel needs no modulo; when the bottom is reached the
+   newest FIR_TAPS - 1 samples move back up. That costs ~100 cycles a sample
+   at FIR_SLACK 2 and saves FIR_TAPS - FIR_SLACK words per input against a
+   line written twice. Inputs must stay within +-16383 so the folded pair
+   sums fit in int16_t (centered 10-bit ADC samples are +-512). */
+typedef struct {
+    int16_t hist[FIR_TAPS + FIR_SLACK];
+    uint8_t pos;
+} fir_state_t;
 
-int16_t fir_process(int16_t input);
+void fir_init(fir_state_t *f);
+int16_t fir_process(fir_state_t *f, int16_t input);
 
-#endif
\ No newline at end of file
+/* Kernel for every fir_state_t from the next sample on (0 .. FIR_PROFILE_COUNT-1);
+   the delay line carries over, so the output settles within the new length */
+void fir_set_profile(uint8_t profile);
+uint8_t fir_profile(void);
+uint8_t fir_taps(void);
+
+/* DC gain of the active profile, Q15 (32768 = 1) */
+uint16_t fir_dc_gain(void);
+
+#endif
@@ -0,0 +1,67 @@
+/* Generated by tools/fir_design.py from tools/fir_profiles.txt, do not edit:
+   change the spec and rebuild. */
+#ifndef FIR_COEFFS_H
+#define FIR_COEFFS_H
+
+#define FIR_PROFILE_COUNT 3
+#define FIR_TAPS_MAX      30
+
+/* 0 wideband: lowpass 440 Hz at 1000 Hz, 30 taps, hamming window; -3 dB passband 0-426 Hz */
+#define FIR_PROFILE_WIDEBAND 0
+#define FIR_WIDEBAND_TAPS 30
+#define FIR_WIDEBAND_DC_GAIN 32768
+#define FIR_WIDEBAND_KERNEL \
+    FIR_PAIR(0, 29, 39) \
+    FIR_PAIR(1, 28, -26) \
+    FIR_PAIR(3, 26, 58) \
+    FIR_PAIR(4, 25, -164) \
+    FIR_PAIR(5, 24, 322) \
+    FIR_PAIR(6, 23, -510) \
+    FIR_PAIR(7, 22, 680) \
+    FIR_PAIR(8, 21, -759) \
+    FIR_PAIR(9, 20, 648) \
+    FIR_PAIR(10, 19, -232) \
+    FIR_PAIR(11, 18, -647) \
+    FIR_PAIR(12, 17, 2288) \
+    FIR_PAIR(13, 16, -5722) \
+    FIR_PAIR(14, 15, 20409)
+
+/* 1 mains50: lowpass 320 Hz at 1000 Hz, 20 taps, hamming window; -3 dB passband 0-298 Hz */
+#define FIR_PROFILE_MAINS50 1
+#define FIR_MAINS50_TAPS 20
+#define FIR_MAINS50_DC_GAIN 32768
+#define FIR_MAINS50_KERNEL \
+    FIR_PAIR(0, 19, 22) \
+    FIR_PAIR(1, 18, -127) \
+    FIR_PAIR(2, 17, 145) \
+    FIR_PAIR(3, 16, 223) \
+    FIR_PAIR(4, 15, -809) \
+    FIR_PAIR(5, 14, 493) \
+    FIR_PAIR(6, 13, 1480) \
+    FIR_PAIR(7, 12, -3381) \
+    FIR_PAIR(8, 11, 824) \
+    FIR_PAIR(9, 10, 17514)
+
+/* 2 mains60: lowpass 380 Hz at 1000 Hz, 20 taps, hamming window; -3 dB passband 0-358 Hz */
+#define FIR_PROFILE_MAINS60 2
+#define FIR_MAINS60_TAPS 20
+#define FIR_MAINS60_DC_GAIN 32768
+#define FIR_MAINS60_KERNEL \
+    FIR_PAIR(0, 19, -56) \
+    FIR_PAIR(1, 18, 128) \
+    FIR_PAIR(2, 17, -199) \
+    FIR_PAIR(3, 16, 87) \
+    FIR_PAIR(4, 15, 434) \
+    FIR_PAIR(5, 14, -1299) \
+    FIR_PAIR(6, 13, 1895) \
+    FIR_PAIR(7, 12, -1099) \
+    FIR_PAIR(8, 11, -2799) \
+    FIR_PAIR(9, 10, 19292)
+
+/* X(NAME, name) for every profile, in index order */
+#define FIR_PROFILES(X) \
+    X(WIDEBAND, wideband) \
+    X(MAINS50, mains50) \
+    X(MAINS60, mains60)
+
+#endif
@@ -0,0 +1,94 @@
+#include <avr/pgmspace.h>
+#include "fixed.h"
+
+// sin(k * pi / 128), k = 0..64, Q15: one quarter wave
+static const int16_t sin_table[65] PROGMEM = {
+    0, 804, 1608, 2410, 3212, 4011, 4808, 5602, 6393, 7179,
+    7962, 8739, 9512, 10278, 11039, 11793, 12539, 13279, 14010, 14732,
+    15446, 16151, 16846, 17530, 18204, 18868, 19519, 20159, 20787, 21403,
+    22005, 22594, 23170, 23731, 24279, 24811, 25329, 25832, 26319, 26790,
+    27245, 27683, 28105, 28510, 28898, 29268, 29621, 29956, 30273, 30571,
+    30852, 31113, 31356, 31580, 31785, 31971, 32137, 32285, 32412, 32521,
+    32609, 32678, 32728, 32757, 32767
+};
+
+uint16_t isqrt32(uint32_t x)
+{
+    uint32_t bit = (uint32_t)1 << 30;
+    uint32_t res = 0;
+
+    while (bit > x) bit >>= 2;
+    while (bit)
+    {
+        if (x >= res + bit)
+        {
+            x -= res + bit;
+            res = (res >> 1) + bit;
+        }
+        else
+        {
+            res >>= 1;
+        }
+        bit >>= 2;
+    }
+    return (uint16_t)res;
+}
+
+uint32_t isqrt64(uint64_t x)
+{
+    if (!(x >> 32)) return isqrt32((uint32_t)x);
+
+    uint64_t bit = (uint64_t)1 << 62;
+    uint64_t res = 0;
+
+    while (bit > x) bit >>= 2;
+    while (bit)
+    {
+        if (x >= res + bit)
+        {
+            x -= res + bit;
+            res = (res >> 1) + bit;
+        }
+        else
+        {
+            res >>= 1;
+        }
+        bit >>= 2;
+    }
+    return (uint32_t)res;
+}
+
+int16_t cos_q14(uint16_t turn)
+{
+    uint16_t t = turn + 0x4000;          // cos(x) = sin(x + quarter turn)
+    uint16_t i = t & 0x3FFF;             // position inside the quadrant
+    if (t & 0x4000) i = 0x4000 - i;      // falling quadrants mirror the table
+
+    // linear interpolation between table entries, 256 steps apart
+    int16_t a = (int16_t)pgm_read_word(&sin_table[i >> 8]);
+    int16_t b = (i >> 8) < 64 ? (int16_t)pgm_read_word(&sin_table[(i >> 8) + 1]) : a;
+    int16_t v = a + (int16_t)(((int32_t)(b - a) * (i & 0xFF)) >> 8);
+
+    v = (v + 1) >> 1;                    // Q15 -> Q14
+    return (t & 0x8000) ? -v : v;
+}
+
+char *fmt_fixed(char *buf, uint32_t v, uint8_t decimals)
+{
+    char digits[10];
+    uint8_t n = 0;
+
+    // at least one digit before the point
+    do {
+        digits[n++] = '0' + (uint8_t)(v % 10);
+        v /= 10;
+    } while (v || n <= decimals);
+
+    while (n)
+    {
+        *buf++ = digits[--n];
+        if (n && n == decimals) *buf++ = '.';
+    }
+    *buf = '\0';
+    return buf;
+}
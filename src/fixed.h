@@ -0,0 +1,17 @@
+#ifndef FIXED_H
+#define FIXED_H
+
+#include <stdint.h>
+
+/* floor(sqrt(x)), bit-by-bit, no multiplies or divides */
+uint16_t isqrt32(uint32_t x);
+uint32_t isqrt64(uint64_t x);
+
+/* cos of an angle in 1/65536 turns, Q14 (16384 = 1.0) */
+int16_t cos_q14(uint16_t turn);
+
+/* Write v / 10^decimals as a decimal string ("0.05", "123.40").
+   Returns a pointer to the terminating NUL so strings can be chained. */
+char *fmt_fixed(char *buf, uint32_t v, uint8_t decimals);
+
+#endif
@@ -2,10 +2,11 @@
 #define FONTS_H
 
 #include <stdint.h>
+#include <avr/pgmspace.h>
 
 /* 5x7 font (columns LSB=top) for ASCII 0x20..0x7E
-   Each glyph is 5 bytes (5 columns). */
-static const uint8_t font5x7[96][5] = {
+   Each glyph is 5 bytes (5 columns), kept in flash. */
+static const uint8_t font5x7[96][5] PROGMEM = {
     {0x00,0x00,0x00,0x00,0x00}, // ' '
     {0x00,0x00,0x5F,0x00,0x00}, // !
     {0x00,0x07,0x00,0x07,0x00}, // "
@@ -103,7 +104,8 @@ static const uint8_t font5x7[96][5] = {
     {0x02,0x01,0x02,0x04,0x02}  // ~
 };
 
-// Helper to get glyph pointer for printable ASCII
+// Helper to get glyph pointer for printable ASCII (flash address, read
+// the columns with pgm_read_byte)
 static inline const uint8_t *font5x7_glyph(char c)
 {
     if ((uint8_t)c < 0x20 || (uint8_t)c > 0x7E) return 0;
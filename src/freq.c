@@ -0,0 +1,108 @@
+#include <util/atomic.h>
+#include "freq.h"
+#include "timer.h"
+
+static uint32_t sample_clock;     // samples since start, wraps harmlessly
+static uint32_t last_crossing;    // confirmed crossing, Q8 samples
+static uint32_t candidate;        // latest rising crossing not yet confirmed
+static uint32_t last_seen;        // sample clock at the last confirmed crossing
+static int16_t  prev;
+static uint8_t  armed;            // signal was below -FREQ_HYSTERESIS
+static uint8_t  have_candidate;
+static uint8_t  tracking;         // last_crossing is valid
+static uint8_t  periods;
+static uint8_t  cycles = FREQ_CYCLES;
+
+// result of the last completed average, read by the main loop
+static volatile uint32_t span;    // Q8 samples covered by span_cycles periods
+static volatile uint8_t  span_cycles;
+
+void freq_init(void)
+{
+    armed = 0;
+    have_candidate = 0;
+    tracking = 0;
+    periods = 0;
+    span_cycles = 0;
+}
+
+void freq_set_cycles(uint8_t n)
+{
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        cycles = n ? n : 1;
+        periods = 0;
+        tracking = 0;
+    }
+}
+
+void freq_push(int16_t x)
+{
+    sample_clock++;
+
+    if (x < -FREQ_HYSTERESIS)
+    {
+        armed = 1;
+        have_candidate = 0;
+    }
+    else if (armed)
+    {
+        if (prev < 0 && x >= 0)
+        {
+            // linear interpolation of the zero between prev and x, in 1/256 sample
+            uint16_t frac = (uint16_t)(((uint32_t)(-(int32_t)prev) << FREQ_FRAC_BITS)
+                                       / (uint16_t)((uint16_t)x - (uint16_t)prev));
+            candidate = ((sample_clock - 1) << FREQ_FRAC_BITS) + frac;
+            have_candidate = 1;
+        }
+
+        if (have_candidate && x > FREQ_HYSTERESIS)
+        {
+            armed = 0;
+            have_candidate = 0;
+            last_seen = sample_clock;
+
+            if (!tracking)
+            {
+                tracking = 1;
+                periods = 0;
+                last_crossing = candidate;
+            }
+            else if (++periods >= cycles)
+            {
+                span = candidate - last_crossing;
+                span_cycles = periods;
+                periods = 0;
+                last_crossing = candidate;
+            }
+        }
+    }
+
+    // no confirmed crossing for half a second (< 2 Hz): signal lost
+    if (tracking && sample_clock - last_seen > SAMPLE_RATE_HZ / 2)
+    {
+        tracking = 0;
+        span_cycles = 0;
+    }
+
+    prev = x;
+}
+
+uint16_t freq_centi_hz(void)
+{
+    uint32_t s;
+    uint8_t n;
+
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        s = span;
+        n = span_cycles;
+    }
+    if (!n || !s) return 0;
+
+    // n periods in s/256 samples of timer1_period() clocks each:
+    // f = n * F_CPU * 256 / (s * period), in 0.01 Hz
+    uint64_t num = (uint64_t)n * ((uint64_t)F_CPU * 100 << FREQ_FRAC_BITS);
+    uint64_t den = (uint64_t)s * timer1_period();
+    return (uint16_t)((num + den / 2) / den);
+}
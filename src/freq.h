@@ -0,0 +1,23 @@
+#ifndef FREQ_H
+#define FREQ_H
+
+#include <stdint.h>
+
+#define FREQ_HYSTERESIS 19    // filtered LSB (ADC LSB << 2); a crossing counts only after -H .. +H
+#define FREQ_CYCLES     10    // default number of periods averaged per estimate
+#define FREQ_FRAC_BITS  8     // crossing instants in 1/256 sample
+
+void freq_init(void);
+
+/* Called from the ADC ISR for every filtered sample. Rising zero crossings
+   are interpolated between samples and timed on a free-running sample
+   clock, so periods are measured across window boundaries. */
+void freq_push(int16_t x);
+
+/* Periods averaged per estimate, 1..255; set through CFG_FREQ_CYCLES */
+void freq_set_cycles(uint8_t cycles);
+
+/* Latest estimate in 0.01 Hz, 0 when no signal is being tracked */
+uint16_t freq_centi_hz(void);
+
+#endif
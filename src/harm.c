@@ -0,0 +1,110 @@
+#include <util/atomic.h>
+#include "harm.h"
+#include "fixed.h"
+#include "rms.h"
+
+static harm_bin_t bins[HARM_BINS];
+static int16_t coeff[HARM_BINS];          // 2 cos(w), Q14, used by the ISR
+static int16_t next_coeff[HARM_BINS];     // placed by the main loop
+static uint8_t valid, next_valid;         // bit per bin, 0 = bank disabled
+static volatile uint8_t coeff_pending;
+
+static const uint8_t harmonic[HARM_BINS] = { 1, 3, 5, 7, 9 };
+
+// (c * s) >> 14 with c in Q14 and |s| < 2^29, built from 16x16 multiplies
+static inline int32_t mul_q14(int16_t c, int32_t s)
+{
+    int16_t hi = (int16_t)(s >> 16);
+    uint16_t lo = (uint16_t)s;
+    return (int32_t)hi * c * 4 + (((int32_t)lo * c) >> 14);
+}
+
+void harm_set_fundamental(uint16_t freq_centi, uint16_t period_ticks)
+{
+    // fundamental in 1/65536 turns per sample: f * period / F_CPU
+    uint16_t turn = (uint16_t)(((uint64_t)freq_centi * period_ticks << 16) / (F_CPU * 100ULL));
+
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        next_valid = 0;
+        for (uint8_t k = 0; k < HARM_BINS; k++)
+        {
+            // bins at or above Nyquist are left out
+            uint32_t t = (uint32_t)turn * harmonic[k];
+            int16_t c = cos_q14((uint16_t)t);
+            next_coeff[k] = (c >= 16384) ? 32767 : c * 2;
+            if (freq_centi && t < 0x8000) next_valid |= 1 << k;
+        }
+        coeff_pending = 1;
+    }
+}
+
+void harm_push(int16_t x)
+{
+    if (!valid) return;
+
+    harm_bin_t *b = bins;
+    const int16_t *c = coeff;
+    for (uint8_t k = 0; k < HARM_BINS; k++, b++, c++)
+    {
+        // s[n] = x[n] + 2cos(w) s[n-1] - s[n-2]
+        int32_t s = x + mul_q14(*c, b->s1) - b->s2;
+        b->s2 = b->s1;
+        b->s1 = s;
+    }
+}
+
+void harm_close_window(harm_window_t *out)
+{
+    for (uint8_t k = 0; k < HARM_BINS; k++)
+    {
+        if (out)
+        {
+            out->bin[k].s1 = bins[k].s1;
+            out->bin[k].s2 = bins[k].s2;
+            out->bin[k].coeff = coeff[k];
+        }
+        bins[k].s1 = 0;
+        bins[k].s2 = 0;
+    }
+    if (out) out->valid = valid;
+
+    if (coeff_pending)
+    {
+        for (uint8_t k = 0; k < HARM_BINS; k++)
+            coeff[k] = next_coeff[k];
+        valid = next_valid;
+        coeff_pending = 0;
+    }
+}
+
+void harm_result(const harm_window_t *w, uint8_t count, harm_result_t *r)
+{
+    uint64_t power[HARM_BINS];
+    uint64_t distortion = 0;
+
+    for (uint8_t k = 0; k < HARM_BINS; k++)
+    {
+        const harm_bin_t *b = &w->bin[k];
+
+        // |X|^2 = s1^2 + s2^2 - 2cos(w) s1 s2; a sine of amplitude A gives (A N / 2)^2
+        int64_t p = (int64_t)b->s1 * b->s1 + (int64_t)b->s2 * b->s2
+                    - (int64_t)mul_q14(b->coeff, b->s1) * b->s2;
+        power[k] = (p > 0 && (w->valid & (1 << k))) ? (uint64_t)p : 0;
+
+        // RMS = sqrt(2 |X|^2) / N, then to 0.01 mA
+        uint32_t rms = count ? isqrt64(power[k] * 2) / count : 0;
+        r->mag[k] = rms_peak_centi((uint16_t)(rms > 0xFFFF ? 0xFFFF : rms));
+
+        if (k) distortion += power[k];
+    }
+
+    // THD = sqrt(sum of harmonic powers / fundamental power), 0.1 %
+    uint64_t fundamental = power[0];
+    while (distortion >= (1ULL << 43) || fundamental >= (1ULL << 43))
+    {
+        distortion >>= 1;
+        fundamental >>= 1;
+    }
+    r->thd = fundamental ? (uint16_t)isqrt64(distortion * 1000000ULL / fundamental) : 0;
+}
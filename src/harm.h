@@ -0,0 +1,39 @@
+#ifndef HARM_H
+#define HARM_H
+
+#include <stdint.h>
+
+/* Goertzel bank on the integrated (current) signal, bins placed on the
+   odd harmonics of the measured fundamental: 1, 3, 5, 7, 9. */
+#define HARM_BINS 5
+
+typedef struct {
+    int32_t s1, s2;      // Goertzel state after the last sample of the window
+    int16_t coeff;       // 2 cos(w), Q14, the bin was run with
+} harm_bin_t;
+
+typedef struct {
+    harm_bin_t bin[HARM_BINS];
+    uint8_t valid;       // bit k set: bin k was placed below Nyquist
+} harm_window_t;
+
+typedef struct {
+    uint16_t thd;              // total harmonic distortion, 0.1 %
+    uint16_t mag[HARM_BINS];   // RMS per harmonic, 0.01 mA
+} harm_result_t;
+
+/* Place the bins for the next window; freq_centi = 0 disables the bank.
+   Called from the main loop; applied at the next window boundary. */
+void harm_set_fundamental(uint16_t freq_centi, uint16_t period_ticks);
+
+/* ADC ISR, every sample: one Goertzel step per bin, ~100 cycles each */
+void harm_push(int16_t x);
+
+/* ADC ISR, at the window boundary: copy the state out (unless out is NULL)
+   and restart */
+void harm_close_window(harm_window_t *out);
+
+/* Main loop: magnitudes and THD from a closed window of count samples */
+void harm_result(const harm_window_t *w, uint8_t count, harm_result_t *r);
+
+#endif
@@ -1,27 +1,107 @@
 #include "i2c.h"
 #include <avr/io.h>
+#include <avr/interrupt.h>
+#include <util/atomic.h>
+#include <util/twi.h>
+
+typedef struct {
+    uint8_t addr;
+    uint8_t hdr_len;
+    const uint8_t *hdr;
+    const uint8_t *data;
+    uint16_t data_len;
+    twi_callback_t done;
+} twi_xfer_t;
+
+// Interrupt-driven TWI master: the ISR walks the queue, one byte per TWINT
+static twi_xfer_t queue[TWI_QUEUE_LEN];
+static volatile uint8_t tail = 0, count = 0;    // count > 0 while the bus is owned
+static uint16_t pos;                       // bytes sent of the current transaction
+
+#define TWCR_GO    ((1<<TWINT)|(1<<TWEN)|(1<<TWIE))
 
-// Basic blocking I2C routines for 100kHz
 void twi_init(void) {
     // SCL frequency = F_CPU / (16 + 2*TWBR*prescaler)
     // prescaler = 1
     TWSR = 0x00; // prescaler = 1
-    TWBR = (uint8_t)(((F_CPU / 100000UL) - 16) / 2);
+    TWBR = (uint8_t)(((F_CPU / TWI_FREQ_HZ) - 16) / 2);
     TWCR = (1<<TWEN);
 }
 
-void twi_start(void) {
-    TWCR = (1<<TWINT)|(1<<TWSTA)|(1<<TWEN);
-    while (!(TWCR & (1<<TWINT)));
+uint8_t twi_submit(uint8_t addr, const uint8_t *hdr, uint8_t hdr_len,
+                   const uint8_t *data, uint16_t data_len, twi_callback_t done) {
+    uint8_t ok = 0;
+
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        if (count < TWI_QUEUE_LEN) {
+            twi_xfer_t *x = &queue[(tail + count) & (TWI_QUEUE_LEN - 1)];
+            x->addr = addr;
+            x->hdr = hdr;
+            x->hdr_len = hdr_len;
+            x->data = data;
+            x->data_len = data_len;
+            x->done = done;
+            ok = 1;
+
+            if (count++ == 0) {
+                pos = 0;
+                while (TWCR & (1<<TWSTO));      // previous STOP still on the bus
+                TWCR = TWCR_GO | (1<<TWSTA);
+            }
+        }
+    }
+    return ok;
+}
+
+uint8_t twi_busy(void) {
+    return count != 0;
 }
 
-void twi_write(uint8_t data) {
-    TWDR = data;
-    TWCR = (1<<TWINT)|(1<<TWEN);
-    while (!(TWCR & (1<<TWINT)));
+void twi_flush(void) {
+    while (count);
 }
 
-void twi_stop(void) {
-    TWCR = (1<<TWINT)|(1<<TWEN)|(1<<TWSTO);
-    
+// end the current transaction and chain the next one with STOP + START
+static void twi_finish(uint8_t status) {
+    twi_callback_t done = queue[tail].done;
+
+    tail = (tail + 1) & (TWI_QUEUE_LEN - 1);
+    pos = 0;
+    if (--count) {
+        TWCR = TWCR_GO | (1<<TWSTO) | (1<<TWSTA);
+    } else {
+        TWCR = (1<<TWINT) | (1<<TWEN) | (1<<TWSTO);
+    }
+
+    if (done) done(status);
+}
+
+ISR(TWI_vect) {
+    const twi_xfer_t *x = &queue[tail];
+
+    switch (TW_STATUS) {
+    case TW_START:
+    case TW_REP_START:
+        TWDR = (x->addr << 1) | 0; // write address
+        TWCR = TWCR_GO;
+        break;
+
+    case TW_MT_SLA_ACK:
+    case TW_MT_DATA_ACK:
+        if (pos < x->hdr_len) {
+            TWDR = x->hdr[pos];
+        } else if (pos - x->hdr_len < x->data_len) {
+            TWDR = x->data[pos - x->hdr_len];
+        } else {
+            twi_finish(TWI_OK);
+            break;
+        }
+        pos++;
+        TWCR = TWCR_GO;
+        break;
+
+    default:    // NACK, arbitration lost, bus error
+        twi_finish(TWI_ERR);
+        break;
+    }
 }
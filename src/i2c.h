@@ -3,9 +3,24 @@
 
 #include <stdint.h>
 
+#define TWI_FREQ_HZ   400000UL  // Fast-mode
+#define TWI_QUEUE_LEN 4         // power of 2, holds one full frame (a transaction per page)
+
+#define TWI_OK  0
+#define TWI_ERR 1               // NACK or arbitration lost
+
+/* Called from the TWI ISR when a transaction has ended */
+typedef void (*twi_callback_t)(uint8_t status);
+
 void twi_init(void);
-void twi_start(void);
-void twi_write(uint8_t data);
-void twi_stop(void);
+
+/* Queue a write transaction: START, SLA+W, hdr bytes, data bytes, STOP.
+   Both buffers must stay valid until the callback; done may be NULL.
+   Returns 0 when the queue is full. */
+uint8_t twi_submit(uint8_t addr, const uint8_t *hdr, uint8_t hdr_len,
+                   const uint8_t *data, uint16_t data_len, twi_callback_t done);
+
+uint8_t twi_busy(void);     // transactions still queued or on the bus
+void twi_flush(void);       // wait for the queue to drain (interrupts on)
 
 #endif
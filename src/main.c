@@ -1,162 +1,237 @@
-
 #include <avr/io.h>
 #include <avr/interrupt.h>
-#include <util/delay.h>
-#include <stdio.h>
-#include <stdlib.h>
+#include <avr/pgmspace.h>
 #include <string.h>
 #include "ssd1306.h"
-#include "fir.h"
 #include "spi.h"
-#include <math.h>
+#include "adc.h"
+#include "timer.h"
+#include "fixed.h"
+#include "rms.h"
+#include "freq.h"
+#include "harm.h"
+#include "capture.h"
+#include "scope.h"
+#include "wave.h"
+#include "config.h"
+#include "calib.h"
 
 #define F_CPU 16000000UL
-#define SAMPLE_RATE_HZ 1000
-#define SAMPLE_COUNT 100
 
-volatile uint16_t samples[SAMPLE_COUNT];
-volatile uint8_t sample_idx = 0;
-volatile uint8_t samples_ready = 0;
+// --- Transient capture: one snapshot chunk per loop, measurement keeps running ---
+uint8_t capture_chunk = 0;
 
-// --- Integration buffer ---
-int16_t integrated[SAMPLE_COUNT];  // store scaled integrated samples in int16_t
+// --- SPI frames: config.batch windows of records per frame ---
+uint8_t spi_batch = 0;
 
-void timer1_init_1khz(void)
+void capture_ship(void)
 {
-    TCCR1A = 0;
-    TCCR1B = (1 << WGM12) | (1 << CS11) | (1 << CS10);
-    OCR1A = (F_CPU / (64UL * SAMPLE_RATE_HZ)) - 1;
-    TIFR1 = (1 << OCF1A);
-    TIMSK1 |= (1 << OCIE1A);
-}
+    if (!capture_ready()) return;
 
-void adc_init(void)
-{
-    ADMUX = (1 << REFS0);
-    ADCSRA = (1 << ADEN) | (1 << ADIE) | (1 << ADPS2) | (1 << ADPS1) | (1 << ADPS0);
-}
+    int16_t chunk[CAPTURE_CHUNK];
+    uint8_t first = capture_chunk * CAPTURE_CHUNK;
+    for (uint8_t i = 0; i < CAPTURE_CHUNK; i++)
+        chunk[i] = capture_sample(first + i);
+    if (!spi_add_capture(capture_event(), capture_chunk, capture_source(), chunk)) return;
 
-ISR(TIMER1_COMPA_vect)
-{
-    ADCSRA |= (1 << ADSC);
+    if (++capture_chunk >= CAPTURE_CHUNKS)
+    {
+        capture_chunk = 0;
+        capture_rearm();
+    }
 }
 
-ISR(ADC_vect)
+// --- Display views (config.h) ---
+uint8_t shown_view = 0xFF;
+
+// --- UI strings, kept in flash ---
+const char title_text[] PROGMEM = "Ipeak    (mA)   Irms";
+ssd1306_label_t title = SSD1306_LABEL(0, 0, title_text, 1);
+const char scope_text[] PROGMEM = "Scope";
+const char trend_text[] PROGMEM = "Trend";
+ssd1306_label_t scope_label = SSD1306_LABEL(0, 0, scope_text, 1);
+ssd1306_label_t trend_label = SSD1306_LABEL(0, 0, trend_text, 1);
+
+// Blank-pad a display line to the panel width so the previous text is
+// overwritten in place; clearing would dirty (and resend) the whole frame.
+void pad_line(char *s, uint8_t scale)
 {
-    if (sample_idx < SAMPLE_COUNT)
-    {
-        samples[sample_idx++] = ADC;
-        if (sample_idx >= SAMPLE_COUNT)
-        {
-            samples_ready = 1;
-            TIMSK1 &= ~(1 << OCIE1A);
-            ADCSRA &= ~(1 << ADEN);
-        }
-    }
+    uint8_t width = SSD1306_WIDTH / ((5 + 1) * scale) + 1;
+    uint8_t n = strlen(s);
+    while (n < width) s[n++] = ' ';
+    s[n] = '\0';
 }
 
-// --- Frequency estimation from filtered samples ---
-float estimate_frequency(int16_t *data, uint8_t count)
+// Retune the sample clock so each window holds SYNC_CYCLES whole cycles;
+// fall back to the configured rate and window when no mains frequency is locked.
+void sync_update(uint16_t freq)
 {
-    uint8_t last = (data[0] >= 0);
-    uint16_t crossings = 0;
+    static uint16_t requested;   // timer1_period() is this rounded to the trigger count
+    uint16_t ticks = config_ticks();
+    uint8_t count = config.window;
 
-    for (uint8_t i = 1; i < count; i++)
+    if (config.sync && freq >= SYNC_MIN_CENTI_HZ && freq <= SYNC_MAX_CENTI_HZ)
     {
-        uint8_t curr = (data[i] >= 0);
-        if (curr != last)
-            crossings++;
-        last = curr;
+        ticks = timer1_sync_period(freq);
+        count = SYNC_SAMPLES_PER_CYCLE * SYNC_CYCLES;
     }
 
-    float freq = ((float)crossings / 2.0f) * ((float)SAMPLE_RATE_HZ / (float)count);
-    return freq;
+    // oversampling follows the rate, within what the ADC keeps up with:
+    // lowered before a faster period starts, raised after a slower one
+    uint8_t log2r = config_decimation(ticks);
+    if (ticks != requested || log2r != adc_decimation())
+    {
+        if (log2r < adc_decimation())
+            adc_set_decimation(log2r);
+        timer1_set_period(ticks);
+        if (log2r > adc_decimation())
+            adc_set_decimation(log2r);
+        requested = ticks;
+        uint16_t period = timer1_period();
+        dsp_set_period(period);
+        rms_set_period(period);   // 1 s aggregates stay 1 s at a locked rate
+    }
+    adc_set_window(count);
 }
 
 int main(void)
 {
-    DDRC &= ~(1 << PC0);
+    DDRC &= ~((1 << ADC_CHANNELS) - 1);   // PC0 .. are the ADC inputs
+    sei();      // the display is driven from the TWI ISR
     ssd1306_init();
     ssd1306_clear();
     ssd1306_update();
+    rms_init();
     adc_init();
+    calib_init();
     spi_init();
-    sei();
-
-    // --- Fixed-point integration scaling ---
-    const int32_t dt_scaled = 327; // integration increment scaling
-    const uint8_t dt_shift = 10;   // right shift to fit int16_t safely
+    wave_configure(config.wave_source, config.wave_delta);
 
-    // --- Scaling factor for display ---
-    const float scale = 5.0f / 32768.0f * (1 << dt_shift); // account for Q15 and shift
+    // --- Continuous capture: Timer1 and the ADC stay running ---
+    timer1_init_1khz();
 
     while (1)
     {
-        sample_idx = 0;
-        samples_ready = 0;
-
-        ADCSRA |= (1 << ADEN) | (1 << ADIE);
-        ADCSRA |= (1 << ADIF);
-
-        TIFR1 = (1 << OCF1A);
-        timer1_init_1khz();
-
-        while (!samples_ready) { }
-
-        // --- Apply FIR filter and fixed-point integration ---
-        int32_t y_acc = 0;   // 32-bit accumulator
-
-        for (uint8_t i = 0; i < SAMPLE_COUNT; i++)
+        // --- Stream waveform chunks while the window fills ---
+        while (!adc_block_ready())
+            wave_pump();
+
+        // --- Window results, already computed sample by sample in the ADC ISR ---
+        dsp_window_t *w = adc_wait_block();
+        uint16_t integrated_peak, integrated_rms;
+
+        // --- Peak and RMS in 0.01 mA, plus the 1 s / 10 s / 60 s aggregates ---
+        uint8_t aggregates = rms_update(w, &integrated_rms, &integrated_peak);
+
+        // --- Harmonic magnitudes and THD from the Goertzel bank ---
+        harm_result_t harm;
+        harm_result(&w->harm, w->count, &harm);
+        uint16_t raw_peak = w->ch[0].peak;
+        uint8_t count = w->count;
+
+        // --- Every input's own window, channel 0 repeated so the record stands alone ---
+        uint16_t ch_peak[ADC_CHANNELS], ch_rms[ADC_CHANNELS];
+        ch_peak[0] = integrated_peak;
+        ch_rms[0] = integrated_rms;
+        for (uint8_t ch = 1; ch < ADC_CHANNELS; ch++)
         {
-            int16_t centered = samples[i] - 512;        // center ADC to 0
-            int16_t filtered = fir_process(centered);   // Q15 filtered sample
-
-            // Fixed-point integration: y[n] = y[n-1] + x[n]*dt_scaled
-            y_acc += (int32_t)filtered * dt_scaled;
-
-            // Scale down to fit int16_t safely
-            integrated[i] = (int16_t)(y_acc >> dt_shift);
-
-            samples[i] = filtered; // store filtered sample back if needed
+            ch_peak[ch] = rms_peak_centi(w->ch[ch].peak);
+            ch_rms[ch] = rms_centi(w->ch[ch].sum_sq, count);
         }
-
-        // --- Compute peak and RMS from integrated array ---
-        int16_t max_integrated = 0;
-        int32_t sum_sq_integrated = 0;
-
-        for (uint8_t i = 0; i < SAMPLE_COUNT; i++)
+        spi_stamp(w->stamp);
+        adc_release_block();
+        capture_rms(integrated_rms);
+
+        // --- Settings relayed by the ESP, applied before the clock is retuned ---
+        uint8_t packet[SPI_HSPI_BYTES];
+        if (spi_command(packet))
+            config_apply(packet);
+
+        // --- Frequency in 0.01 Hz, interpolated crossings of the filtered signal ---
+        uint16_t freq = freq_centi_hz();
+        sync_update(freq);
+        harm_set_fundamental(freq, timer1_period());
+
+        // --- Display: redraw only once the previous frame has left the bus ---
+        if (config.view != shown_view)
         {
-            int16_t val = integrated[i];
-            if (val < 0) val = -val;  // absolute value
+            scope_stop();           // its trace lives in the plot pages
+            ssd1306_clear();
+            shown_view = config.view;
+            if (shown_view == VIEW_TREND) trend_reset();
+        }
+        if (shown_view == VIEW_TREND) trend_push(integrated_rms);
 
-            if (val > max_integrated) max_integrated = val;
-            sum_sq_integrated += (int32_t)val * val;
+        if (!ssd1306_busy())
+        {
+            char display[32];
+            char *p;
+
+            if (shown_view == VIEW_NUMBERS)
+            {
+                p = fmt_fixed(display, integrated_peak, 2);
+                *p++ = '-';
+                fmt_fixed(p, integrated_rms, 2);
+                pad_line(display, 2);
+
+                ssd1306_draw_label(&title);
+                ssd1306_draw_string_big(0, 8, display, 2);
+                strcpy_P(display, PSTR("Freq: "));
+                p = fmt_fixed(display + 6, freq, 2);
+                strcpy_P(p, PSTR(" Hz"));
+                pad_line(display, 1);
+                ssd1306_draw_string_big(0, 24, display, 1);
+                ssd1306_update();
+            }
+            else if (shown_view == VIEW_SCOPE)
+            {
+                if (scope_ready())
+                {
+                    // header: peak of the window, the trace spans +-peak
+                    scope_trace_t *t = scope_trace();
+                    ssd1306_draw_label(&scope_label);
+                    p = fmt_fixed(display, integrated_peak, 2);
+                    strcpy_P(p, PSTR(" mA"));
+                    pad_line(display, 1);
+                    ssd1306_draw_string_big(48, 0, display, 1);
+                    ssd1306_invalidate(SCOPE_PAGE, SCOPE_PAGES);
+                    ssd1306_plot(0, SCOPE_PAGE, SCOPE_PAGES, t->lo, t->hi, SCOPE_COLS, SCOPE_COLS);
+                    ssd1306_update();
+                    scope_stop();
+                }
+                else if (!scope_busy())
+                {
+                    // the bus is idle: the next trace may take over the plot pages
+                    scope_arm(1, raw_peak);
+                }
+            }
+            else
+            {
+                // trend_push() has drawn the plot
+                ssd1306_draw_label(&trend_label);
+                p = fmt_fixed(display, integrated_rms, 2);
+                strcpy_P(p, PSTR(" mA"));
+                pad_line(display, 1);
+                ssd1306_draw_string_big(48, 0, display, 1);
+                ssd1306_update();
+            }
         }
 
-        float integrated_peak = max_integrated * scale;
-        float integrated_rms  = sqrt((float)(sum_sq_integrated / SAMPLE_COUNT)) * scale;
-
-        // --- Frequency from filtered samples ---
-        float freq = estimate_frequency(samples, SAMPLE_COUNT);
-        // --- Send data via SPI ---
-    
-
-        // --- Display ---
-        char I_peak[6], I_rms[6], Freq[6], display[32];
-        dtostrf(integrated_peak, 0, 2, I_peak);
-        dtostrf(integrated_rms, 0, 2, I_rms);
-        dtostrf(freq, 0, 1, Freq);
-
-        snprintf(display, sizeof(display), "%s-%s", I_peak, I_rms);
-        ssd1306_clear();
-        ssd1306_draw_string_big(0, 0, "Ipeak    (mA)   Irms", 1);
-        ssd1306_draw_string_big(0, 8, display, 2);
-        snprintf(display, sizeof(display), "Freq: %s Hz", Freq);
-        ssd1306_draw_string_big(0, 24, display, 1);
-        ssd1306_update();
-            spi_send_current((uint16_t)(integrated_peak * 100.0f) ,(uint16_t)(integrated_rms  * 100.0f), (uint16_t)(freq * 10.0f));
-
-        _delay_ms(200);
+        // --- Queue records for the SPI link ---
+        spi_add_current(count, integrated_peak, integrated_rms, freq, &harm);
+        if (ADC_CHANNELS > 1)
+            spi_add_channels(ADC_CHANNELS, ch_peak, ch_rms);
+        for (uint8_t level = 0; level < RMS_LEVELS; level++)
+        {
+            if (aggregates & (1 << level))
+                spi_add_aggregate(level, rms_aggregate(level));
+        }
+        capture_ship();
+        if (++spi_batch >= config.batch)
+        {
+            spi_batch = 0;
+            spi_flush();
+        }
     }
 }
 
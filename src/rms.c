@@ -0,0 +1,111 @@
+#include "rms.h"
+#include "fixed.h"
+
+/* Running state of one aggregate level */
+typedef struct {
+    uint64_t sum_sq;      // raw sum of squares over the span
+    uint32_t count;       // raw samples over the span
+    uint16_t rms_min;
+    uint16_t rms_max;
+    uint16_t peak_hold;
+    uint8_t  children;    // windows or lower-level aggregates folded in
+} rms_level_t;
+
+static rms_level_t levels[RMS_LEVELS];
+static rms_aggregate_t results[RMS_LEVELS];
+
+static const uint8_t level_span[RMS_LEVELS] = { 0, RMS_SPAN_10S, RMS_SPAN_60S };
+static uint16_t span_1s = RMS_SPAN_1S_SAMPLES;
+static uint16_t centi_scale = CENTI_SCALE << CENTI_GAIN_BITS;   // CENTI_SCALE x gain
+
+// 0.01 mA values saturate at 655.35 mA instead of wrapping
+static uint16_t centi_sat(uint32_t v)
+{
+    return (v > 0xFFFF) ? 0xFFFF : (uint16_t)v;
+}
+
+uint16_t rms_peak_centi(uint16_t peak)
+{
+    return centi_sat(((uint32_t)peak * centi_scale + (1UL << (CENTI_SHIFT + CENTI_GAIN_BITS - 1)))
+                     >> (CENTI_SHIFT + CENTI_GAIN_BITS));
+}
+
+uint16_t rms_centi(uint64_t sum_sq, uint32_t count)
+{
+    if (!count) return 0;
+    // mean square <= 2^30 and centi_scale < 2^16, so the product fits 64 bits
+    uint64_t mean_sq = sum_sq / count;
+    return centi_sat((isqrt64(mean_sq * ((uint32_t)centi_scale * centi_scale))
+                      + (1UL << (CENTI_SHIFT + CENTI_GAIN_BITS - 1))) >> (CENTI_SHIFT + CENTI_GAIN_BITS));
+}
+
+static void level_reset(rms_level_t *l)
+{
+    l->sum_sq = 0;
+    l->count = 0;
+    l->rms_min = 0xFFFF;
+    l->rms_max = 0;
+    l->peak_hold = 0;
+    l->children = 0;
+}
+
+static void level_fold(rms_level_t *l, uint64_t sum_sq, uint32_t count,
+                       uint16_t rms_min, uint16_t rms_max, uint16_t peak)
+{
+    l->sum_sq += sum_sq;
+    l->count += count;
+    if (rms_min < l->rms_min) l->rms_min = rms_min;
+    if (rms_max > l->rms_max) l->rms_max = rms_max;
+    if (peak > l->peak_hold) l->peak_hold = peak;
+    l->children++;
+}
+
+void rms_init(void)
+{
+    for (uint8_t i = 0; i < RMS_LEVELS; i++)
+        level_reset(&levels[i]);
+}
+
+void rms_set_period(uint16_t ticks)
+{
+    span_1s = (F_CPU + ticks / 2) / ticks;
+}
+
+void rms_set_gain(uint16_t gain)
+{
+    centi_scale = ((uint32_t)(CENTI_SCALE << CENTI_GAIN_BITS) * gain + (1UL << 13)) >> 14;
+}
+
+uint8_t rms_update(const dsp_window_t *w, uint16_t *rms, uint16_t *peak)
+{
+    uint8_t done = 0;
+
+    *rms = rms_centi(w->ch[0].sum_sq, w->count);
+    *peak = rms_peak_centi(w->ch[0].peak);
+
+    level_fold(&levels[0], w->ch[0].sum_sq, w->count, *rms, *rms, *peak);
+
+    for (uint8_t i = 0; i < RMS_LEVELS; i++)
+    {
+        rms_level_t *l = &levels[i];
+        if (i == 0 ? l->count < span_1s : l->children < level_span[i])
+            break;
+
+        rms_aggregate_t *r = &results[i];
+        r->rms_min = l->rms_min;
+        r->rms_max = l->rms_max;
+        r->rms_mean = rms_centi(l->sum_sq, l->count);
+        r->peak_hold = l->peak_hold;
+        done |= 1 << i;
+
+        if (i + 1 < RMS_LEVELS)
+            level_fold(&levels[i + 1], l->sum_sq, l->count, l->rms_min, l->rms_max, l->peak_hold);
+        level_reset(l);
+    }
+    return done;
+}
+
+const rms_aggregate_t *rms_aggregate(uint8_t level)
+{
+    return &results[level];
+}
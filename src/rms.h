@@ -0,0 +1,56 @@
+#ifndef RMS_H
+#define RMS_H
+
+#include <stdint.h>
+#include "dsp.h"
+#include "timer.h"
+
+// --- Display scaling, fixed point ---
+// 1 LSB of the integrated signal = 8.47 / 32768 * 2^DSP_DT_SHIFT mA (Q15 and shift),
+// so in units of 0.01 mA it is CENTI_SCALE / 2^CENTI_SHIFT. The coil scale is
+// 5 mA per LSB through the original FIR table, whose gain in the mains band was
+// 1.694; the generated profiles (fir.h) have unity gain, so it is 5 x 1.694.
+#define CENTI_SCALE 847UL
+#define CENTI_SHIFT (15 - DSP_DT_SHIFT)
+#define CENTI_GAIN_BITS 4   // extra scale resolution for the calibrated gain
+
+// --- Aggregate levels: 1 s built from windows, 10 s from 1 s, 60 s from 10 s ---
+#define RMS_LEVEL_1S   0
+#define RMS_LEVEL_10S  1
+#define RMS_LEVEL_60S  2
+#define RMS_LEVELS     3
+
+#define RMS_SPAN_1S_SAMPLES ((uint32_t)SAMPLE_RATE_HZ)  // samples per 1 s aggregate (nominal rate)
+#define RMS_SPAN_10S        10      // 1 s aggregates per 10 s aggregate
+#define RMS_SPAN_60S        6       // 10 s aggregates per 60 s aggregate
+
+/* Completed aggregate of one level, all values in 0.01 mA */
+typedef struct {
+    uint16_t rms_min;     // lowest window RMS
+    uint16_t rms_max;     // highest window RMS
+    uint16_t rms_mean;    // true RMS over the whole span
+    uint16_t peak_hold;   // highest window peak
+} rms_aggregate_t;
+
+uint16_t rms_peak_centi(uint16_t peak);
+uint16_t rms_centi(uint64_t sum_sq, uint32_t count);
+
+void rms_init(void);
+
+/* Samples per 1 s aggregate for a sample period of ticks CPU clocks, the
+   configured or the mains-locked one (timer1_period()) */
+void rms_set_period(uint16_t ticks);
+
+/* Calibrated gain, Q14 (calib.h), applied to every 0.01 mA conversion */
+void rms_set_gain(uint16_t gain);
+
+/* Fold one window into the 1 s level and, when a span completes, cascade it
+   into the next level. Constant time per window, no history is kept; the
+   aggregates follow channel 0, the other inputs are reported per window.
+   Writes the window's own RMS/peak and returns a bit mask (1 << level) of
+   the aggregates that completed with this window. */
+uint8_t rms_update(const dsp_window_t *w, uint16_t *rms, uint16_t *peak);
+
+const rms_aggregate_t *rms_aggregate(uint8_t level);
+
+#endif
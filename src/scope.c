@@ -0,0 +1,176 @@
+#include <util/atomic.h>
+#include "scope.h"
+#include "ssd1306.h"
+
+#if SCOPE_PAGES < 2 || SCOPE_COLS != SSD1306_WIDTH || SCOPE_PAGE + SCOPE_PAGES > SSD1306_PAGES
+#error "the trace needs two full-width plot pages"
+#endif
+
+#define SCOPE_IDLE    0
+#define SCOPE_TRIGGER 1
+#define SCOPE_RUN     2
+#define SCOPE_READY   3
+
+static scope_trace_t *trace;        // in the framebuffer, see scope.h
+static volatile uint8_t state = SCOPE_IDLE;
+static uint8_t decim, phase, col;
+static uint8_t wait;                 // samples left before a free-running start
+static int16_t prev;
+static uint16_t gain;                // Q16: plot rows per LSB
+
+static uint8_t trend_shift, trend_fill, trend_count;
+static uint8_t trend_lo, trend_hi;   // rows of the newest column
+static uint8_t prev_lo, prev_hi;     // and of the one before, for the join
+
+void scope_arm(uint8_t d, uint16_t full_scale)
+{
+    // half the plot height above and below the middle row
+    uint32_t g = ((uint32_t)(SCOPE_ROWS / 2 - 1) << 16) / (full_scale ? full_scale : 1);
+
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        trace = (scope_trace_t *)ssd1306_page_data(SCOPE_PAGE + SCOPE_PAGES - 2);
+        decim = d ? d : 1;
+        gain = g > 0xFFFF ? 0xFFFF : (uint16_t)g;
+        phase = 0;
+        col = 0;
+        wait = SCOPE_COLS;
+        state = SCOPE_TRIGGER;
+    }
+}
+
+void scope_push(int16_t y)
+{
+    uint8_t st = state;
+    if (st == SCOPE_IDLE || st == SCOPE_READY) return;
+
+    if (st == SCOPE_TRIGGER)
+    {
+        uint8_t rising = prev < 0 && y >= 0;
+        prev = y;
+        if (!rising && --wait) return;
+        state = SCOPE_RUN;
+    }
+
+    int16_t row = SCOPE_ROWS / 2 + (int16_t)(((int32_t)y * gain) >> 16);
+    if (row < 0) row = 0;
+    if (row > SCOPE_ROWS - 1) row = SCOPE_ROWS - 1;
+
+    if (phase == 0)
+    {
+        trace->lo[col] = row;
+        trace->hi[col] = row;
+    }
+    else
+    {
+        if (row < trace->lo[col]) trace->lo[col] = row;
+        if (row > trace->hi[col]) trace->hi[col] = row;
+    }
+
+    if (++phase >= decim)
+    {
+        phase = 0;
+        if (++col >= SCOPE_COLS) state = SCOPE_READY;
+    }
+}
+
+void scope_stop(void)
+{
+    state = SCOPE_IDLE;
+}
+
+uint8_t scope_busy(void)
+{
+    uint8_t st = state;
+    return st == SCOPE_TRIGGER || st == SCOPE_RUN;
+}
+
+uint8_t scope_ready(void)
+{
+    return state == SCOPE_READY;
+}
+
+scope_trace_t *scope_trace(void)
+{
+    return trace;
+}
+
+// Draw the newest column, joined to the one before as ssd1306_plot() would
+static void trend_draw(void)
+{
+    uint8_t lo = trend_lo, hi = trend_hi;
+    if (trend_fill > 1)
+    {
+        if (lo > prev_hi) lo = prev_hi;
+        if (hi < prev_lo) hi = prev_lo;
+    }
+    ssd1306_plot_column(trend_fill - 1, SCOPE_PAGE, SCOPE_PAGES, lo, hi);
+}
+
+// Halve the rows of every column on screen. Each is one bar, and halving
+// commutes with the join, so the bars are redrawn from their end rows.
+static void trend_halve(void)
+{
+    for (uint8_t x = 0; x < trend_fill; x++)
+    {
+        uint32_t bits = ssd1306_plot_bits(x, SCOPE_PAGE, SCOPE_PAGES);
+        uint8_t top = 0xFF, bottom = 0;
+        for (uint8_t k = 0; k < SCOPE_ROWS; k++)
+        {
+            if (bits & ((uint32_t)1 << k))
+            {
+                if (top == 0xFF) top = k;
+                bottom = k;
+            }
+        }
+        if (top == 0xFF) continue;
+        // bit 0 is the top row
+        ssd1306_plot_column(x, SCOPE_PAGE, SCOPE_PAGES,
+                            (SCOPE_ROWS - 1 - bottom) >> 1, (SCOPE_ROWS - 1 - top) >> 1);
+    }
+    trend_lo >>= 1;
+    trend_hi >>= 1;
+    prev_lo >>= 1;
+    prev_hi >>= 1;
+}
+
+void trend_reset(void)
+{
+    scope_stop();                   // the trend owns the plot now
+    ssd1306_plot(0, SCOPE_PAGE, SCOPE_PAGES, 0, 0, 0, SCOPE_COLS);
+    trend_shift = 0;
+    trend_fill = 0;
+    trend_count = 0;
+}
+
+void trend_push(uint16_t rms)
+{
+    // grow the scale until the new value fits, halving what is on screen
+    while ((rms >> trend_shift) > SCOPE_ROWS - 1)
+    {
+        trend_shift++;
+        trend_halve();
+    }
+    uint8_t row = rms >> trend_shift;
+
+    if (trend_count == 0)
+    {
+        // new column at the right edge
+        if (trend_fill < SCOPE_COLS)
+            trend_fill++;
+        else
+            ssd1306_plot_scroll(SCOPE_PAGE, SCOPE_PAGES);
+        prev_lo = trend_lo;
+        prev_hi = trend_hi;
+        trend_lo = row;
+        trend_hi = row;
+    }
+    else
+    {
+        if (row < trend_lo) trend_lo = row;
+        if (row > trend_hi) trend_hi = row;
+    }
+    trend_draw();
+
+    if (++trend_count >= TREND_WINDOWS) trend_count = 0;
+}
@@ -0,0 +1,45 @@
+#ifndef SCOPE_H
+#define SCOPE_H
+
+#include <stdint.h>
+
+// --- Plot geometry: pages 1..3 of the panel, page 0 keeps a text line ---
+#define SCOPE_COLS  128
+#define SCOPE_PAGE  1
+#define SCOPE_PAGES 3
+#define SCOPE_ROWS  (SCOPE_PAGES * 8)      // row 0 at the bottom
+
+// --- Trend view ---
+#define TREND_WINDOWS 5                    // windows folded into one column
+
+/* One min/max bar per column, in plot rows. It has no RAM of its own: it
+   is kept in the last two plot pages of the framebuffer (lo[] then hi[]),
+   which ssd1306_plot() turns into pixels in place. */
+typedef struct {
+    uint8_t lo[SCOPE_COLS];
+    uint8_t hi[SCOPE_COLS];
+} scope_trace_t;
+
+/* Waveform view: start a trace on the next rising zero crossing (or after
+   SCOPE_COLS samples without one), decim samples per column, full_scale
+   (integrated LSB) mapped to the top of the plot. Arm only while no frame
+   is on the bus (ssd1306_busy()): the trace overwrites the plot pages. */
+void scope_arm(uint8_t decim, uint16_t full_scale);
+void scope_stop(void);                    // before anything else draws the plot
+uint8_t scope_busy(void);                 // armed or tracing
+
+/* ADC ISR, every sample */
+void scope_push(int16_t y);
+
+/* Complete trace, stays put until scope_stop() or the next scope_arm().
+   Draw it with ssd1306_invalidate() and ssd1306_plot() over the plot pages. */
+uint8_t scope_ready(void);
+scope_trace_t *scope_trace(void);
+
+/* Trend view, main loop: one window RMS (0.01 mA) at a time, scrolling left
+   every TREND_WINDOWS windows with power-of-two autoscale. It is drawn
+   straight into the plot pages, which hold its only copy. */
+void trend_reset(void);                   // stops the scope, blanks the plot
+void trend_push(uint16_t rms);
+
+#endif
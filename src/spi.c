@@ -1,44 +1,264 @@
+#include <avr/interrupt.h>
+#include <util/crc16.h>
 #include "spi.h"
+#include "timer.h"
 
-// Initialize SPI as master
- spi_init(void) {
+// TX ring: [tx_tail, tx_head) belongs to the SPI ISR, the open frame is
+// built in place from frame_start to wr and published by spi_flush().
+// The indices run free through 0..255 and are masked on access.
+#define RING(i) ring[(uint8_t)(i) & (SPI_TX_RING - 1)]
+static uint8_t ring[SPI_TX_RING];
+static volatile uint8_t tx_head, tx_tail;
+static uint8_t wr, frame_start, frame_open, nrec, seq;
+static uint8_t frame_windows;         // SPI_REC_CURRENT records in the open frame
+static uint8_t frame_stale;           // opened before the last spi_stamp()
+static uint32_t stamp;
+static uint16_t dropped;
+
+static volatile uint8_t slot_pos;     // bytes into the HSPI transaction, 0 = idle
+static uint8_t slot_read, poll_slots;
+
+// Downlink: filled by the SPI ISR during a read slot, owned by spi_command() once ready
+static uint8_t cmd_buf[SPI_HSPI_BYTES];
+static volatile uint8_t cmd_ready;
+static uint8_t cmd_seq;
+
+// Initialize SPI as master, interrupt driven, with the Timer2 slot pacer
+void spi_init(void) {
     // Set MOSI, SCK, SS as output
     DDRB |= (1 << MOSI_PIN) | (1 << SCK_PIN) | (1 << SS_PIN);
-    // Enable SPI, Master, set clock rate fck/16
-    SPCR = (1 << SPE) | (1 << MSTR) | (1 << SPR0);
+    // Enable SPI, Master, set clock rate fck/16, transfer complete interrupt
+    SPCR = (1 << SPE) | (1 << MSTR) | (1 << SPR0) | (1 << SPIE);
     CS_HIGH(); // Set SS high
+
+    // Timer2 CTC, /64: one HSPI write slot every SPI_SLOT_US
+    TCCR2A = (1 << WGM21);
+    TCCR2B = (1 << CS22);
+    OCR2A = (uint8_t)((F_CPU / 64) * SPI_SLOT_US / 1000000UL - 1);
+    TIMSK2 = (1 << OCIE2A);
 }
 
-// Transmit a single byte
- spi_send_byte(uint8_t data) {
-    SPDR = data;               
-    while (!(SPSR & (1 << SPIF))); 
+static inline void put8(uint8_t b) {
+    RING(wr++) = b;
 }
 
-// Transmit a 16-bit value (high byte first)
- spi_send_uint16(uint16_t data) {
-    spi_send_byte((data >> 8) & 0xFF); // MSB
-    spi_send_byte(data & 0xFF);        // LSB
+static inline void put16(uint16_t v) {
+    put8(v >> 8);   // MSB
+    put8(v);        // LSB
 }
 
-void spi_send_current(uint16_t peak, uint16_t rms, uint16_t freq) {
-    CS_LOW();
-    _delay_us(5);          
+void spi_stamp(uint32_t clock) {
+    stamp = clock;
+    frame_stale = frame_open;
+}
+
+static inline uint8_t spi_room(void) {
+    return SPI_TX_RING - 1 - (uint8_t)(wr - tx_tail);
+}
+
+// Open a record of len payload bytes, opening or rolling the frame as needed
+// so that follow more bytes of records still fit in it, leaving at least
+// reserve bytes of the ring free
+static uint8_t spi_record(uint8_t type, uint8_t len, uint8_t follow, uint8_t reserve) {
+    uint8_t need = 2 + len;
+
+    if (frame_open && (uint8_t)(wr - frame_start) + need + follow + SPI_FRAME_CRC > SPI_FRAME_MAX)
+        spi_flush();
+
+    uint8_t want = need + follow + SPI_FRAME_CRC + (frame_open ? 0 : SPI_FRAME_HEAD) + reserve;
+    // A window's records come in one burst and a rolled frame may still be
+    // in the ring: measurement records wait for the link to drain it, a few
+    // ms at most, waveform records (reserve) are dropped instead
+    while (!reserve && spi_room() < want && tx_tail != tx_head)
+        ;
+    if (spi_room() < want) {
+        dropped++;
+        return 0;
+    }
+
+    if (!frame_open) {
+        frame_start = wr;
+        put8(SPI_SOF);
+        put8(SPI_VERSION);
+        put8(0);                        // len, set by spi_flush()
+        put8(seq);
+        put16(stamp >> 16);
+        put16(stamp);
+        put8(0);                        // nrec, set by spi_flush()
+        frame_open = 1;
+        frame_stale = 0;
+        frame_windows = 0;
+        nrec = 0;
+    }
+
+    put8(type);
+    put8(len);
+    nrec++;
+    return 1;
+}
+
+void spi_flush(void) {
+    if (!frame_open) return;
+
+    RING(frame_start + 2) = (uint8_t)(wr - frame_start - 3);
+    RING(frame_start + 8) = nrec;
+
+    uint16_t crc = 0xFFFF;
+    for (uint8_t i = frame_start + 1; i != wr; i++)
+        crc = _crc_xmodem_update(crc, RING(i));
+    put16(crc);
+
+    tx_head = wr;                       // hand the frame to the ISR
+    seq++;
+    frame_open = 0;
+}
+
+uint16_t spi_dropped(void) {
+    return dropped;
+}
 
-    // Header / command
-    spi_send_byte(0x02);   // Command
-    spi_send_byte(0x00);   
+uint8_t spi_command(uint8_t *packet) {
+    if (!cmd_ready) return 0;
 
-    // Data
-    spi_send_uint16(peak);
-    spi_send_uint16(rms);
-    spi_send_uint16(freq);
+    uint16_t crc = 0xFFFF;
+    for (uint8_t i = 1; i < SPI_HSPI_BYTES - 2; i++)
+        crc = _crc_xmodem_update(crc, cmd_buf[i]);
 
+    uint8_t fresh = cmd_buf[0] == SPI_CMD_SOF && cmd_buf[1] == SPI_CMD_VERSION
+                    && crc == (uint16_t)((cmd_buf[SPI_HSPI_BYTES - 2] << 8) | cmd_buf[SPI_HSPI_BYTES - 1])
+                    && cmd_buf[2] != cmd_seq && cmd_buf[3] <= SPI_CMD_MAX;
+    if (fresh) {
+        cmd_seq = cmd_buf[2];
+        for (uint8_t i = 0; i < SPI_HSPI_BYTES; i++)
+            packet[i] = cmd_buf[i];
+    }
+    cmd_ready = 0;                      // next read slot may overwrite it
+    return fresh;
+}
+
+uint8_t spi_add_current(uint8_t count, uint16_t peak, uint16_t rms, uint16_t freq, const harm_result_t *harm) {
+    // The frame stamp belongs to its first window. A frame that trailing
+    // records of the previous window rolled into carries that window's
+    // stamp, so this window starts a frame of its own.
+    if (frame_open && frame_stale && !frame_windows)
+        spi_flush();
+    // the window's SPI_REC_CHANNELS record goes in the same frame
+    if (!spi_record(SPI_REC_CURRENT, 1 + 8 + 2 * HARM_BINS,
+                    ADC_CHANNELS > 1 ? 2 + 1 + 4 * ADC_CHANNELS : 0, 0)) return 0;
+    frame_windows++;
+
+    put8(count);
+    put16(peak);
+    put16(rms);
+    put16(freq);
+    put16(harm->thd);
+    for (uint8_t k = 0; k < HARM_BINS; k++)
+        put16(harm->mag[k]);
+    return 1;
+}
 
+uint8_t spi_add_aggregate(uint8_t level, const rms_aggregate_t *a) {
+    if (!spi_record(SPI_REC_AGGREGATE, 9, 0, 0)) return 0;
 
-    CS_HIGH();
-    _delay_us(5);          
+    put8(level);
+    put16(a->rms_min);
+    put16(a->rms_max);
+    put16(a->rms_mean);
+    put16(a->peak_hold);
+    return 1;
 }
 
+uint8_t spi_add_capture(uint8_t event, uint8_t chunk, uint8_t source, const int16_t *samples) {
+    if (!spi_record(SPI_REC_CAPTURE, 5 + 2 * CAPTURE_CHUNK, 0, 0)) return 0;
+
+    put8(event);
+    put8(chunk);
+    put8(CAPTURE_CHUNKS);
+    put8(source);
+    put8(CAPTURE_PRE);
+    for (uint8_t i = 0; i < CAPTURE_CHUNK; i++)
+        put16((uint16_t)samples[i]);
+    return 1;
+}
 
+uint8_t spi_add_wave(uint8_t source, uint8_t flags, uint16_t first, uint8_t n,
+                     const uint8_t *data, uint8_t len) {
+    if (!spi_record(SPI_REC_WAVE, 5 + len, 0, SPI_WAVE_RESERVE)) return 0;
+
+    put8(source);
+    put8(flags);
+    put16(first);
+    put8(n);
+    while (len--)
+        put8(*data++);
+    return 1;
+}
+
+uint8_t spi_add_config(uint8_t seq, uint8_t n, const uint8_t *keys, const uint16_t *values) {
+    if (!spi_record(SPI_REC_CONFIG, 2 + 3 * n, 0, 0)) return 0;
+
+    put8(seq);
+    put8(n);
+    for (uint8_t i = 0; i < n; i++) {
+        put8(keys[i]);
+        put16(values[i]);
+    }
+    return 1;
+}
 
+uint8_t spi_add_channels(uint8_t n, const uint16_t *peak, const uint16_t *rms) {
+    if (!spi_record(SPI_REC_CHANNELS, 1 + 4 * n, 0, 0)) return 0;
+
+    put8(n);
+    for (uint8_t i = 0; i < n; i++) {
+        put16(peak[i]);
+        put16(rms[i]);
+    }
+    return 1;
+}
+
+// Slot pacer: poll for a command every SPI_CMD_POLL_SLOTS, otherwise start an
+// HSPI write when there is something to send
+ISR(TIMER2_COMPA_vect) {
+    if (slot_pos) return;
+    if (poll_slots < SPI_CMD_POLL_SLOTS) poll_slots++;
+
+    if (poll_slots >= SPI_CMD_POLL_SLOTS && !cmd_ready) {
+        poll_slots = 0;
+        slot_read = 1;
+    } else if (tx_head != tx_tail) {
+        slot_read = 0;
+    } else {
+        return;
+    }
+    CS_LOW();
+    slot_pos = 1;
+    SPDR = slot_read ? SPI_HSPI_READ : SPI_HSPI_WRITE;
+}
+
+ISR(SPI_STC_vect) {
+    uint8_t n = slot_pos;
+
+    if (slot_read && n >= 3)
+        cmd_buf[n - 3] = SPDR;          // byte clocked in by the transfer that just ended
+
+    if (n == 1) {
+        SPDR = 0x00;                    // slave buffer address
+    } else if (n < 2 + SPI_HSPI_BYTES) {
+        uint8_t t = tx_tail;
+        if (slot_read) {
+            SPDR = 0x00;
+        } else if (t != tx_head) {
+            SPDR = RING(t);
+            tx_tail = t + 1;
+        } else {
+            SPDR = 0x00;                // idle padding, skipped by the parser
+        }
+    } else {
+        CS_HIGH();
+        slot_pos = 0;
+        if (slot_read) cmd_ready = 1;
+        return;
+    }
+    slot_pos = n + 1;
+}
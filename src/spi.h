@@ -3,7 +3,9 @@
 
 #include <stdint.h>
 #include <avr/io.h>
-#include <util/delay.h>
+#include "rms.h"
+#include "harm.h"
+#include "capture.h"
 
 
 #define SS_PIN   PB2
@@ -15,11 +17,85 @@
 #define CS_HIGH()  (PORTB |=  (1 << SS_PIN))
 
 
+/* Link: every SPI_SLOT_US the Timer2 ISR starts one ESP8266 HSPI slave
+   write, [0x02 write command][0x00 address][32 bytes], and the SPI ISR
+   clocks out the bytes from the TX ring, padding with 0x00 when it runs
+   dry. The 32-byte payloads form a byte stream the ESP parses frames from. */
+#define SPI_HSPI_WRITE  0x02
+#define SPI_HSPI_READ   0x03
+#define SPI_HSPI_BYTES  32
+#define SPI_SLOT_US     1000     // 32 kB/s of stream
+#define SPI_TX_RING     128      // power of 2, <= 128 so uint8_t indices can run free
+
+/* Downlink: every SPI_CMD_POLL_SLOTS slots one slot is an HSPI read,
+   [0x03 read command][0x00 address][32 dummy bytes], that clocks in the
+   ESP's read buffer on MISO. The buffer holds one command packet:
+   [SOF 0x5A] [version] [seq] [n] [key, value (2)] x n, zero padded,
+   [CRC16, 2] in the last two bytes, over version .. padding. The ESP's
+   buffer keeps its last packet, so a packet is applied once per seq. */
+#define SPI_CMD_POLL_SLOTS  100  // 100 ms
+#define SPI_CMD_SOF         0x5A
+#define SPI_CMD_VERSION     0x01
+#define SPI_CMD_HEAD        4
+#define SPI_CMD_MAX         8    // settings per packet
+
+/* Frame, multi-byte fields MSB first:
+   [SOF 0xA5] [version] [len] [seq] [timestamp, 4] [nrec] [records] [CRC16, 2]
+   len counts seq .. last record, timestamp is the sample clock at the end
+   of the first window in the frame, CRC-16/CCITT-FALSE over version .. last
+   record. Record: [type] [len] [payload]. */
+#define SPI_SOF           0xA5
+#define SPI_VERSION       0x01
+#define SPI_FRAME_MAX     96     // whole frame, SOF to CRC; fits the TX ring, the ESP takes up to 128
+#define SPI_FRAME_HEAD    9      // SOF .. nrec
+#define SPI_FRAME_CRC     2
+
+#define SPI_REC_CURRENT   0x00   // count, peak, rms, freq, thd, HARM_BINS harmonic magnitudes
+#define SPI_REC_AGGREGATE 0x01   // level, rms min, rms max, rms mean, peak hold
+#define SPI_REC_CAPTURE   0x02   // event, chunk, chunks, source, pre, CAPTURE_CHUNK samples
+#define SPI_REC_WAVE      0x03   // source, flags, first sample index (2), n, samples (wave.h)
+#define SPI_REC_CONFIG    0x04   // seq, n, [key, applied value (2)] x n (config.h)
+#define SPI_REC_CHANNELS  0x05   // n, [peak, rms] x n: every input of the window (ADC_CHANNELS > 1)
+
+/* Bandwidth budget: the link moves 32 bytes per slot, 32 kB/s. A 1 kHz
+   waveform costs ~2.4 kB/s raw (16 samples in 39 bytes of record and
+   framing) and less delta-encoded. Waveform records are only queued while
+   SPI_WAVE_RESERVE bytes of the TX ring stay free, enough for a frame of
+   summary records, so streaming never starves the measurement path. */
+#define SPI_WAVE_RESERVE  64
+
 void spi_init(void);
-void spi_send_byte(uint8_t data);
-void spi_send_uint16(uint16_t data);
 
+/* Records go into the open frame, one is opened on demand with the clock
+   of the last spi_stamp(). A record that does not fit closes the frame and
+   starts the next one. A window's SPI_REC_CURRENT never joins a frame that
+   holds only records stamped before it, so the frame stamp is always the
+   end of its first window. A record waits while published frames drain
+   (32 bytes a slot); it returns 0 (dropped) when the TX ring is still full,
+   or at once for waveform records. */
+void spi_stamp(uint32_t clock);
+uint8_t spi_add_current(uint8_t count, uint16_t peak, uint16_t rms, uint16_t freq, const harm_result_t *harm);
+uint8_t spi_add_aggregate(uint8_t level, const rms_aggregate_t *a);
+uint8_t spi_add_capture(uint8_t event, uint8_t chunk, uint8_t source, const int16_t *samples);
+uint8_t spi_add_wave(uint8_t source, uint8_t flags, uint16_t first, uint8_t n,
+                     const uint8_t *data, uint8_t len);
+
+uint8_t spi_add_config(uint8_t seq, uint8_t n, const uint8_t *keys, const uint16_t *values);
+
+/* Follows the window's SPI_REC_CURRENT, whose stamp and frame it shares
+   (spi_add_current() leaves room for it) */
+uint8_t spi_add_channels(uint8_t n, const uint16_t *peak, const uint16_t *rms);
+
+/* Windows batched into one frame by the main loop (default, see config.h) */
+#define SPI_BATCH_WINDOWS 2
+
+/* Close the open frame and hand it to the link */
+void spi_flush(void);
+
+uint16_t spi_dropped(void);      // records that found the TX ring full
 
-void spi_send_current(uint16_t peak, uint16_t rms, uint16_t freq);
+/* Copies a new, valid command packet to packet (SPI_HSPI_BYTES) and returns 1;
+   0 when nothing new has been read */
+uint8_t spi_command(uint8_t *packet);
 
-#endif 
\ No newline at end of file
+#endif
@@ -1,117 +1,369 @@
 #include <avr/io.h>
 #include <stdint.h>
 #include <string.h>
-#include <stdlib.h>  
+#include <avr/pgmspace.h>
+#include <util/atomic.h>
 #include "ssd1306.h"
 #include "i2c.h"
 #include "fonts.h"
+#include "fixed.h"
 
 
 // framebuffer for 128x32 => 128 * 4 pages = 512 bytes
 static uint8_t ssd1306_buffer[SSD1306_WIDTH * SSD1306_PAGES];
 
-// low-level I2C command
-static void ssd1306_write_command(uint8_t cmd) {
-    twi_start();
-    twi_write((SSD1306_I2C_ADDR << 1) | 0); // write address
-    twi_write(0x00); // control byte: Co=0, D/C#=0 (command)
-    twi_write(cmd);
-    twi_stop();
+// I2C control bytes: Co=0, D/C#=0 (command) / D/C#=1 (data)
+static const uint8_t ssd1306_ctrl_cmd = 0x00;
+static const uint8_t ssd1306_ctrl_data = 0x40;
+
+// Init sequence for 128x32, sent as a single command transaction from a
+// copy in the (not yet used) framebuffer
+static const uint8_t ssd1306_init_seq[] PROGMEM = {
+    0xAE,
+    0x20, 0x02,     // page addressing: each page is written on its own
+    0xB0,
+    0xC8,
+    0x00,
+    0x10,
+    0x40,
+    0x81, 0x7F,
+    0xA1,
+    0xA6,
+    0xA8, 0x1F,
+    0xA4,
+    0xD3, 0x00,
+    0xD5, 0x80,
+    0xD9, 0xF1,
+    0xDA, 0x02,
+    0xDB, 0x40,
+    0x8D, 0x14,
+    0xAF,
+};
+
+// Dirty column range per page, clean when min > max
+static uint8_t ssd1306_dirty_min[SSD1306_PAGES];
+static uint8_t ssd1306_dirty_max[SSD1306_PAGES];
+
+// Per-page header for one transaction: Co=1 command pairs set the page and
+// the start column (page addressing mode), then Co=0 D/C#=1 streams the
+// data bytes.
+#define SSD1306_HDR_LEN 7
+#define SSD1306_HDR_PAGE     1
+#define SSD1306_HDR_COL_LOW  3
+#define SSD1306_HDR_COL_HIGH 5
+static uint8_t ssd1306_page_hdr[SSD1306_PAGES][SSD1306_HDR_LEN];
+
+static inline void ssd1306_mark(uint8_t page, uint8_t col) {
+    if (col < ssd1306_dirty_min[page]) ssd1306_dirty_min[page] = col;
+    if (col > ssd1306_dirty_max[page]) ssd1306_dirty_max[page] = col;
+}
+
+static void ssd1306_mark_all(void) {
+    for (uint8_t page = 0; page < SSD1306_PAGES; page++) {
+        ssd1306_dirty_min[page] = 0;
+        ssd1306_dirty_max[page] = SSD1306_WIDTH - 1;
+    }
+}
+
+// One bit per page: queued on the bus / dropped by it, to be sent again
+static volatile uint8_t ssd1306_in_flight = 0;
+static volatile uint8_t ssd1306_failed = 0;
+static uint8_t ssd1306_generation = 0;
+
+static void ssd1306_page_done(uint8_t status) {
+    // transactions end in queue order: this is the lowest page still queued
+    uint8_t bit = ssd1306_in_flight & -ssd1306_in_flight;
+    if (status != TWI_OK) ssd1306_failed |= bit;
+    ssd1306_in_flight &= ~bit;
 }
 
 void ssd1306_init(void) {
     twi_init();
+    memcpy_P(ssd1306_buffer, ssd1306_init_seq, sizeof(ssd1306_init_seq));
+    twi_submit(SSD1306_I2C_ADDR, &ssd1306_ctrl_cmd, 1,
+               ssd1306_buffer, sizeof(ssd1306_init_seq), 0);
+    twi_flush();
 
-    // Init sequence for 128x32
-    ssd1306_write_command(0xAE);
-    ssd1306_write_command(0x20); ssd1306_write_command(0x00);
-    ssd1306_write_command(0xB0);
-    ssd1306_write_command(0xC8);
-    ssd1306_write_command(0x00);
-    ssd1306_write_command(0x10);
-    ssd1306_write_command(0x40);
-    ssd1306_write_command(0x81); ssd1306_write_command(0x7F);
-    ssd1306_write_command(0xA1);
-    ssd1306_write_command(0xA6);
-    ssd1306_write_command(0xA8); ssd1306_write_command(0x1F);
-    ssd1306_write_command(0xA4);
-    ssd1306_write_command(0xD3); ssd1306_write_command(0x00);
-    ssd1306_write_command(0xD5); ssd1306_write_command(0x80);
-    ssd1306_write_command(0xD9); ssd1306_write_command(0xF1);
-    ssd1306_write_command(0xDA); ssd1306_write_command(0x02);
-    ssd1306_write_command(0xDB); ssd1306_write_command(0x40);
-    ssd1306_write_command(0x8D); ssd1306_write_command(0x14);
-    ssd1306_write_command(0xAF);
+    for (uint8_t page = 0; page < SSD1306_PAGES; page++) {
+        static const uint8_t hdr[SSD1306_HDR_LEN] PROGMEM = {
+            0x80, 0xB0, 0x80, 0x00, 0x80, 0x10,
+            0x40,
+        };
+        memcpy_P(ssd1306_page_hdr[page], hdr, SSD1306_HDR_LEN);
+    }
 
+    // panel RAM is undefined after power-up: send the whole frame once
     memset(ssd1306_buffer, 0, sizeof(ssd1306_buffer));
+    ssd1306_mark_all();
     ssd1306_update();
+    twi_flush();
 }
 
 void ssd1306_clear(void) {
-    memset(ssd1306_buffer, 0x00, sizeof(ssd1306_buffer));
+    ssd1306_generation++;       // cached labels must be drawn again
+    uint8_t *b = ssd1306_buffer;
+    for (uint8_t page = 0; page < SSD1306_PAGES; page++) {
+        for (uint8_t col = 0; col < SSD1306_WIDTH; col++, b++) {
+            if (*b) {
+                *b = 0;
+                ssd1306_mark(page, col);
+            }
+        }
+    }
+}
+
+uint8_t ssd1306_busy(void) {
+    return ssd1306_in_flight != 0;
+}
+
+uint8_t *ssd1306_page_data(uint8_t page) {
+    return &ssd1306_buffer[page * SSD1306_WIDTH];
+}
+
+void ssd1306_invalidate(uint8_t page, uint8_t pages) {
+    for (uint8_t k = 0; k < pages && page + k < SSD1306_PAGES; k++) {
+        ssd1306_dirty_min[page + k] = 0;
+        ssd1306_dirty_max[page + k] = SSD1306_WIDTH - 1;
+    }
 }
 
 void ssd1306_update(void) {
+    // the TWI ISR reads straight from the framebuffer; one frame at a time
+    if (ssd1306_in_flight) return;
+
+    // a page the bus dropped (NACK, lost arbitration) goes out again in full
     for (uint8_t page = 0; page < SSD1306_PAGES; page++) {
-        ssd1306_write_command(0xB0 | page);
-        ssd1306_write_command(0x00);
-        ssd1306_write_command(0x10);
-
-        twi_start();
-        twi_write((SSD1306_I2C_ADDR << 1) | 0);
-        twi_write(0x40);
-        for (uint8_t col = 0; col < SSD1306_WIDTH; col++) {
-            twi_write(ssd1306_buffer[page * SSD1306_WIDTH + col]);
+        if (ssd1306_failed & (1 << page)) ssd1306_invalidate(page, 1);
+    }
+    ssd1306_failed = 0;
+
+    for (uint8_t page = 0; page < SSD1306_PAGES; page++) {
+        uint8_t first = ssd1306_dirty_min[page];
+        uint8_t end = ssd1306_dirty_max[page];
+        if (first > end) continue;
+
+        uint8_t *hdr = ssd1306_page_hdr[page];
+        hdr[SSD1306_HDR_PAGE] = 0xB0 | page;
+        hdr[SSD1306_HDR_COL_LOW] = first & 0x0F;
+        hdr[SSD1306_HDR_COL_HIGH] = 0x10 | (first >> 4);
+        ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+            ssd1306_in_flight |= 1 << page;
         }
-        twi_stop();
+        if (!twi_submit(SSD1306_I2C_ADDR, hdr, SSD1306_HDR_LEN,
+                        &ssd1306_buffer[page * SSD1306_WIDTH + first], end - first + 1,
+                        ssd1306_page_done)) {
+            // queue full: this page and the rest stay dirty for the next update
+            ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+                ssd1306_in_flight &= ~(1 << page);
+            }
+            return;
+        }
+
+        ssd1306_dirty_min[page] = 0xFF;
+        ssd1306_dirty_max[page] = 0;
     }
 }
 
 void ssd1306_draw_pixel(uint8_t x, uint8_t y, uint8_t color) {
     if (x >= SSD1306_WIDTH || y >= SSD1306_HEIGHT) return;
-    uint16_t index = (y / 8) * SSD1306_WIDTH + x;
+    uint8_t page = y / 8;
+    uint16_t index = page * SSD1306_WIDTH + x;
     uint8_t bit = 1 << (y & 7);
-    if (color) ssd1306_buffer[index] |= bit;
-    else ssd1306_buffer[index] &= ~bit;
+    uint8_t old = ssd1306_buffer[index];
+    uint8_t val = color ? (old | bit) : (old & ~bit);
+    if (val != old) {
+        ssd1306_buffer[index] = val;
+        ssd1306_mark(page, x);
+    }
 }
 
 
+// --- Column blitter ---
+
+// Bit-stretch tables: each source bit becomes 2 (3) adjacent bits
+static const uint8_t ssd1306_stretch2[16] PROGMEM = {
+    0x00, 0x03, 0x0C, 0x0F, 0x30, 0x33, 0x3C, 0x3F,
+    0xC0, 0xC3, 0xCC, 0xCF, 0xF0, 0xF3, 0xFC, 0xFF,
+};
+static const uint16_t ssd1306_stretch3[16] PROGMEM = {
+    0x000, 0x007, 0x038, 0x03F, 0x1C0, 0x1C7, 0x1F8, 0x1FF,
+    0xE00, 0xE07, 0xE38, 0xE3F, 0xFC0, 0xFC7, 0xFF8, 0xFFF,
+};
+
+static inline void ssd1306_put_byte(uint8_t page, uint8_t x, uint8_t val, uint8_t mask) {
+    uint8_t *b = &ssd1306_buffer[page * SSD1306_WIDTH + x];
+    uint8_t nv = (*b & ~mask) | (val & mask);
+    if (nv != *b) {
+        *b = nv;
+        ssd1306_mark(page, x);
+    }
+}
+
+// Write n bytes of one column (bit 0 on top) starting at pixel row y
+static void ssd1306_put_column(uint8_t x, uint8_t y, const uint8_t *col, uint8_t n) {
+    uint8_t page = y >> 3;
+    uint8_t shift = y & 7;
+
+    if (!shift) {
+        // byte-aligned: straight copy
+        for (uint8_t i = 0; i < n && page < SSD1306_PAGES; i++, page++)
+            ssd1306_put_byte(page, x, col[i], 0xFF);
+        return;
+    }
+
+    // unaligned: each byte straddles two pages
+    uint8_t carry = 0;
+    for (uint8_t i = 0; i <= n && page < SSD1306_PAGES; i++, page++) {
+        uint8_t lo_mask = i < n ? (uint8_t)(0xFF << shift) : 0;
+        uint8_t hi_mask = i > 0 ? (uint8_t)(0xFF >> (8 - shift)) : 0;
+        uint8_t v = i < n ? col[i] : 0;
+        ssd1306_put_byte(page, x, (uint8_t)(v << shift) | carry, lo_mask | hi_mask);
+        carry = v >> (8 - shift);
+    }
+}
 
 static void ssd1306_draw_char_big_internal(uint8_t x, uint8_t y, char c, uint8_t scale) {
     const uint8_t spacing = 1;
     const uint8_t *glyph = font5x7_glyph(c);
-    if (!glyph) return; // unsupported character, skip
 
-    for (uint8_t col = 0; col < 5; col++) {
-        uint8_t colbits = glyph[col];
-        for (uint8_t sx = 0; sx < scale; sx++) {
-            for (uint8_t row = 0; row < 8; row++) {
-                uint8_t pixel = (colbits >> row) & 1;
-                for (uint8_t sy = 0; sy < scale; sy++) {
-                    ssd1306_draw_pixel(x + col * scale + sx, y + row * scale + sy, pixel);
+    // the whole cell is drawn, spacing column and unsupported characters
+    // blank, so text can be redrawn in place without clearing
+    for (uint8_t col = 0; col < 5 + spacing; col++) {
+        uint8_t colbits = (glyph && col < 5) ? pgm_read_byte(&glyph[col]) : 0;
+        uint8_t stretched[3];
+
+        if (scale == 1) {
+            stretched[0] = colbits;
+        } else if (scale == 2) {
+            stretched[0] = pgm_read_byte(&ssd1306_stretch2[colbits & 0x0F]);
+            stretched[1] = pgm_read_byte(&ssd1306_stretch2[colbits >> 4]);
+        } else if (scale == 3) {
+            uint32_t v = pgm_read_word(&ssd1306_stretch3[colbits & 0x0F])
+                       | ((uint32_t)pgm_read_word(&ssd1306_stretch3[colbits >> 4]) << 12);
+            stretched[0] = (uint8_t)v;
+            stretched[1] = (uint8_t)(v >> 8);
+            stretched[2] = (uint8_t)(v >> 16);
+        } else {
+            // larger scales: per-pixel fallback
+            for (uint8_t sx = 0; sx < scale; sx++) {
+                for (uint8_t row = 0; row < 8; row++) {
+                    uint8_t pixel = (colbits >> row) & 1;
+                    for (uint8_t sy = 0; sy < scale; sy++) {
+                        ssd1306_draw_pixel(x + col * scale + sx, y + row * scale + sy, pixel);
+                    }
                 }
             }
+            continue;
+        }
+
+        for (uint8_t sx = 0; sx < scale; sx++) {
+            uint8_t px = x + col * scale + sx;
+            if (px >= SSD1306_WIDTH) return;
+            ssd1306_put_column(px, y, stretched, scale);
         }
     }
 }
 
 void ssd1306_draw_string_big(uint8_t x, uint8_t y, const char *s, uint8_t scale) {
-    uint8_t cursor_x = x;
-    while (*s) {
+    uint16_t cursor_x = x;
+    if (y >= SSD1306_HEIGHT) return;
+    while (*s && cursor_x < SSD1306_WIDTH) {
         ssd1306_draw_char_big_internal(cursor_x, y, *s, scale);
         cursor_x += (5 + 1) * scale;
         s++;
     }
 }
 
-void ssd1306_print_float_big(uint8_t x, uint8_t y, float v, uint8_t decimals, uint8_t scale) {
+void ssd1306_draw_string_big_P(uint8_t x, uint8_t y, PGM_P s, uint8_t scale) {
+    uint16_t cursor_x = x;
+    char c;
+    if (y >= SSD1306_HEIGHT) return;
+    while ((c = pgm_read_byte(s)) && cursor_x < SSD1306_WIDTH) {
+        ssd1306_draw_char_big_internal(cursor_x, y, c, scale);
+        cursor_x += (5 + 1) * scale;
+        s++;
+    }
+}
+
+// --- Plot ---
+
+void ssd1306_plot(uint8_t x, uint8_t page, uint8_t pages,
+                  const uint8_t *lo, const uint8_t *hi, uint8_t n, uint8_t width) {
+    uint8_t rows = pages * 8;
+    uint8_t prev_lo = 0, prev_hi = 0;
+
+    for (uint8_t i = 0; i < width && x + i < SSD1306_WIDTH; i++) {
+        if (i >= n) {
+            ssd1306_plot_column(x + i, page, pages, 1, 0);
+            continue;
+        }
+
+        // read before drawing: lo and hi may live in the plot's own pages
+        uint8_t l = lo[i], h = hi[i];
+        if (h >= rows) h = rows - 1;
+        if (l > h) l = h;
+        uint8_t cl = l, ch = h;
+        if (i) {
+            // join the previous column
+            if (cl > prev_hi) cl = prev_hi;
+            if (ch < prev_lo) ch = prev_lo;
+        }
+        prev_lo = l;
+        prev_hi = h;
+        ssd1306_plot_column(x + i, page, pages, cl, ch);
+    }
+}
+
+void ssd1306_plot_column(uint8_t x, uint8_t page, uint8_t pages, uint8_t lo, uint8_t hi) {
+    uint8_t rows = pages * 8;
+    uint32_t bits = 0;
+
+    if (x >= SSD1306_WIDTH) return;
+    if (hi >= rows) hi = rows - 1;
+    if (lo <= hi) {
+        // bit 0 is the top row of the plot
+        uint8_t len = hi - lo + 1;
+        bits = (len >= 32 ? 0xFFFFFFFFUL : (((uint32_t)1 << len) - 1)) << (rows - 1 - hi);
+    }
+
+    for (uint8_t k = 0; k < pages && page + k < SSD1306_PAGES; k++) {
+        ssd1306_put_byte(page + k, x, (uint8_t)bits, 0xFF);
+        bits >>= 8;
+    }
+}
+
+uint32_t ssd1306_plot_bits(uint8_t x, uint8_t page, uint8_t pages) {
+    uint32_t bits = 0;
+    for (uint8_t k = pages; k--; )
+        bits = (bits << 8) | ssd1306_buffer[(page + k) * SSD1306_WIDTH + x];
+    return bits;
+}
+
+void ssd1306_plot_scroll(uint8_t page, uint8_t pages) {
+    for (uint8_t k = 0; k < pages && page + k < SSD1306_PAGES; k++) {
+        uint8_t *b = &ssd1306_buffer[(page + k) * SSD1306_WIDTH];
+        memmove(b, b + 1, SSD1306_WIDTH - 1);
+        b[SSD1306_WIDTH - 1] = 0;
+    }
+    ssd1306_invalidate(page, pages);
+}
+
+// --- Static labels ---
+
+void ssd1306_draw_label(ssd1306_label_t *l) {
+    if (l->drawn && l->generation == ssd1306_generation) return;
+    ssd1306_draw_string_big_P(l->x, l->y, l->s, l->scale);
+    l->drawn = 1;
+    l->generation = ssd1306_generation;
+}
+
+void ssd1306_print_fixed_big(uint8_t x, uint8_t y, int32_t v, uint8_t decimals, uint8_t scale) {
     char buf[16];
-    if (v < 0.0f) {
+    if (v < 0) {
         buf[0] = '-';
-        v = -v;
-        dtostrf(v, 0, decimals, buf + 1);
+        fmt_fixed(buf + 1, (uint32_t)-v, decimals);
     } else {
-        dtostrf(v, 0, decimals, buf);
+        fmt_fixed(buf, (uint32_t)v, decimals);
     }
     ssd1306_draw_string_big(x, y, buf, scale);
     ssd1306_update();
@@ -2,22 +2,62 @@
 #define SSD1306_H
 
 #include <stdint.h>
+#include <avr/pgmspace.h>
 
 #define SSD1306_WIDTH 128
 #define SSD1306_HEIGHT 32
 #define SSD1306_PAGES  (SSD1306_HEIGHT/8)
 #define SSD1306_I2C_ADDR 0x3C
 
+/* Needs interrupts enabled: the display is driven by the TWI ISR */
 void ssd1306_init(void);
 void ssd1306_clear(void);
+/* Queue the changed columns of every page for transfer; ignored while a
+   frame is in flight. Pages the bus drops are sent again by the next call. */
 void ssd1306_update(void);
+uint8_t ssd1306_busy(void);
 void ssd1306_draw_pixel(uint8_t x, uint8_t y, uint8_t color);
 
 /* Draw scaled digits, dot, minus. scale >=1 */
 void ssd1306_draw_string_big(uint8_t x, uint8_t y, const char *s, uint8_t scale);
+/* Same, string in flash */
+void ssd1306_draw_string_big_P(uint8_t x, uint8_t y, PGM_P s, uint8_t scale);
 
-/* Print helpers: writes into framebuffer and updates display */
+/* Bar plot over pages [page, page + pages), pages <= 4: column x + i spans
+   plot rows lo[i]..hi[i] (row 0 at the bottom), stretched to meet the
+   previous column so the trace is continuous. Columns n..width-1 are
+   blanked. Only bytes that change are marked dirty. */
+void ssd1306_plot(uint8_t x, uint8_t page, uint8_t pages,
+                  const uint8_t *lo, const uint8_t *hi, uint8_t n, uint8_t width);
+
+/* One plot column spanning rows lo..hi, as is (no join); lo > hi blanks it */
+void ssd1306_plot_column(uint8_t x, uint8_t page, uint8_t pages, uint8_t lo, uint8_t hi);
+/* Pixels of a plot column, bit 0 the top row */
+uint32_t ssd1306_plot_bits(uint8_t x, uint8_t page, uint8_t pages);
+/* Move the plot one column left, blanking the right edge */
+void ssd1306_plot_scroll(uint8_t page, uint8_t pages);
+
+/* Raw framebuffer bytes of a page. A caller may keep its own data there
+   while the page is not drawn (nothing sends it until it is marked dirty),
+   then ssd1306_invalidate() the pages once they hold pixels again: the
+   panel no longer matches the framebuffer, so every byte is resent. */
+uint8_t *ssd1306_page_data(uint8_t page);
+void ssd1306_invalidate(uint8_t page, uint8_t pages);
+
+/* Static text (in flash) rendered once into the framebuffer and kept there until the
+   next ssd1306_clear(); redrawing it every frame costs nothing */
+typedef struct {
+    uint8_t x, y, scale;
+    PGM_P s;
+    uint8_t drawn, generation;
+} ssd1306_label_t;
+
+#define SSD1306_LABEL(x, y, s, scale) { (x), (y), (scale), (s), 0, 0 }
+
+void ssd1306_draw_label(ssd1306_label_t *l);
+
+/* Print helpers: writes into framebuffer and queues a display update */
 void ssd1306_print_big_text(uint8_t x, uint8_t y, const char *s, uint8_t scale);
-void ssd1306_print_float_big(uint8_t x, uint8_t y, float v, uint8_t decimals, uint8_t scale);
+void ssd1306_print_fixed_big(uint8_t x, uint8_t y, int32_t v, uint8_t decimals, uint8_t scale);
 
 #endif
@@ -0,0 +1,74 @@
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <util/atomic.h>
+#include "timer.h"
+
+static volatile uint16_t period = TIMER1_TICKS_NOMINAL;
+static uint8_t oversampling = 0;   // log2 of ADC triggers per sample and channel
+
+// CPU clocks between ADC triggers, less one
+static inline uint16_t trigger_top(void)
+{
+    return (period >> oversampling) / ADC_CHANNELS - 1;
+}
+
+// Timer1 in CTC mode, no prescaler, one compare match per ADC conversion.
+// Running at the CPU clock gives 1/16000 period resolution at 1 kHz,
+// fine enough to lock the sample rate to the mains frequency.
+// OCR1B = 0 raises OCF1B once per period, which auto-triggers the ADC.
+void timer1_init_1khz(void)
+{
+    TCCR1A = 0;
+    TCCR1B = (1 << WGM12) | (1 << CS10);
+    OCR1A = trigger_top();
+    OCR1B = 0;
+    TIFR1 = (1 << OCF1A) | (1 << OCF1B);
+}
+
+// the compare A interrupt is only enabled while a new TOP is waiting
+static void timer1_load(void)
+{
+    TIFR1 = (1 << OCF1A);
+    TIMSK1 |= (1 << OCIE1A);
+}
+
+void timer1_set_period(uint16_t ticks)
+{
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        period = ticks;
+        timer1_load();
+    }
+}
+
+void timer1_set_oversampling(uint8_t log2r)
+{
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        oversampling = log2r;
+        timer1_load();
+    }
+}
+
+uint16_t timer1_period(void)
+{
+    uint16_t t;
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        t = ((trigger_top() + 1) * ADC_CHANNELS) << oversampling;
+    }
+    return t;
+}
+
+uint16_t timer1_sync_period(uint16_t freq_centi)
+{
+    uint32_t den = (uint32_t)freq_centi * SYNC_SAMPLES_PER_CYCLE;
+    return (uint16_t)((F_CPU * 100UL + den / 2) / den);
+}
+
+ISR(TIMER1_COMPA_vect)
+{
+    // TCNT1 has just wrapped, so a new TOP cannot be missed
+    OCR1A = trigger_top();
+    TIMSK1 &= ~(1 << OCIE1A);
+}
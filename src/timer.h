@@ -0,0 +1,44 @@
+#ifndef TIMER_H
+#define TIMER_H
+
+#include <stdint.h>
+
+#define SAMPLE_RATE_HZ 1000
+#define TIMER1_TICKS_NOMINAL (F_CPU / SAMPLE_RATE_HZ)  // CPU clocks per sample
+
+// --- Multi-channel: ADC0 .. ADC_CHANNELS-1 converted in turn every sample (adc.h) ---
+#ifndef ADC_CHANNELS
+#define ADC_CHANNELS 1      // set from the makefile; ~120 B of SRAM per extra input, see README
+#endif
+#define ADC_CHANNELS_MAX 4
+#if ADC_CHANNELS < 1 || ADC_CHANNELS > ADC_CHANNELS_MAX
+#error "ADC_CHANNELS must be 1 .. ADC_CHANNELS_MAX"
+#endif
+#if ADC_CHANNELS > 2 && defined(__AVR_ATmega328P__)
+#error "3 or 4 inputs leave too little of the ATmega328P's 2 KB SRAM for the stack"
+#endif
+
+// --- Mains-synchronous sampling: fixed samples per cycle, whole cycles per window ---
+#define SYNC_SAMPLES_PER_CYCLE 20
+#define SYNC_CYCLES            4
+#define SYNC_MIN_CENTI_HZ      4000   // lock range 40..70 Hz
+#define SYNC_MAX_CENTI_HZ      7000
+
+void timer1_init_1khz(void);
+
+/* Sample period (after decimation) in CPU clocks. The new period is loaded
+   by the compare ISR right after a match, so no period is ever stretched
+   by the update. timer1_period() is the period in effect, the requested
+   one rounded down as below. */
+void timer1_set_period(uint16_t ticks);
+uint16_t timer1_period(void);
+
+/* ADC trigger rate is ADC_CHANNELS x 2^log2r times the sample rate; Timer1
+   compare match B starts each conversion (ADC auto trigger). The sample
+   period is rounded down to a multiple of the trigger count. */
+void timer1_set_oversampling(uint8_t log2r);
+
+/* Period giving SYNC_SAMPLES_PER_CYCLE samples per cycle of freq_centi */
+uint16_t timer1_sync_period(uint16_t freq_centi);
+
+#endif
@@ -0,0 +1,124 @@
+#include <util/atomic.h>
+#include "wave.h"
+#include "spi.h"
+
+static int16_t ring[WAVE_RING];
+static volatile uint16_t head;       // free-running sample index
+static uint16_t tail;                // next sample for the main loop
+static volatile uint8_t source = WAVE_SRC_OFF;
+static uint8_t flags;
+static uint16_t lost;
+
+void wave_configure(uint8_t src, uint8_t delta)
+{
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        source = src;
+        flags = delta ? WAVE_DELTA : 0;
+        tail = head;
+    }
+}
+
+void wave_push(int16_t raw, int16_t filtered, int16_t current)
+{
+    uint8_t src = source;
+    if (src == WAVE_SRC_OFF) return;
+
+    int16_t v = (src == WAVE_SRC_RAW) ? raw : (src == WAVE_SRC_FILTERED) ? filtered : current;
+    uint16_t h = head;
+    ring[h & (WAVE_RING - 1)] = v;
+    head = h + 1;
+}
+
+// Delta-encode n samples into out, returns the bytes used, or 0 when the
+// chunk would come out longer than raw (2 n bytes, the size of out)
+static uint8_t wave_encode(const int16_t *s, uint8_t n, uint8_t *out)
+{
+    uint8_t len = 0;
+
+    out[len++] = (uint16_t)s[0] >> 8;
+    out[len++] = (uint8_t)s[0];
+    for (uint8_t i = 1; i < n; i++)
+    {
+        int16_t d = s[i] - s[i - 1];
+        uint8_t esc = d < -127 || d > 127;
+        if (len + (esc ? 3 : 1) > 2 * n)
+            return 0;
+        if (!esc)
+        {
+            out[len++] = (uint8_t)(int8_t)d;
+        }
+        else
+        {
+            out[len++] = WAVE_DELTA_ESC;
+            out[len++] = (uint16_t)s[i] >> 8;
+            out[len++] = (uint8_t)s[i];
+        }
+    }
+    return len;
+}
+
+uint8_t wave_pump(void)
+{
+    uint8_t sent = 0;
+
+    for (;;)
+    {
+        uint16_t h;
+        ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+        {
+            h = head;
+        }
+
+        if ((uint16_t)(h - tail) > WAVE_RING)
+        {
+            // the ISR lapped us: skip to the oldest sample still in the ring
+            lost += (uint16_t)(h - tail) - WAVE_RING;
+            tail = h - WAVE_RING;
+        }
+        if ((uint16_t)(h - tail) < WAVE_CHUNK) break;
+
+        int16_t chunk[WAVE_CHUNK];
+        for (uint8_t i = 0; i < WAVE_CHUNK; i++)
+            chunk[i] = ring[(tail + i) & (WAVE_RING - 1)];
+
+        // the ISR may have overwritten the chunk while it was copied
+        ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+        {
+            h = head;
+        }
+        if ((uint16_t)(h - tail) > WAVE_RING) continue;
+
+        // delta-encode when asked to, unless the chunk is too busy for it
+        uint8_t buf[2 * WAVE_CHUNK];
+        uint8_t f = flags;
+        uint8_t len = 0;
+        if (f & WAVE_DELTA)
+        {
+            len = wave_encode(chunk, WAVE_CHUNK, buf);
+            if (!len) f &= ~WAVE_DELTA;
+        }
+        if (!(f & WAVE_DELTA))
+        {
+            len = 0;
+            for (uint8_t i = 0; i < WAVE_CHUNK; i++)
+            {
+                buf[len++] = (uint16_t)chunk[i] >> 8;
+                buf[len++] = (uint8_t)chunk[i];
+            }
+        }
+
+        if (spi_add_wave(source, f, tail, WAVE_CHUNK, buf, len))
+            sent++;
+        tail += WAVE_CHUNK;
+    }
+
+    // hand the records to the link now, the TX ring is too small to batch them
+    if (sent) spi_flush();
+    return sent;
+}
+
+uint16_t wave_lost(void)
+{
+    return lost;
+}
@@ -0,0 +1,37 @@
+#ifndef WAVE_H
+#define WAVE_H
+
+#include <stdint.h>
+
+// --- Waveform streaming: a tap on the ADC ISR pipeline, drained by the main loop ---
+#define WAVE_RING   32      // samples buffered for the main loop, power of 2, two chunks
+#define WAVE_CHUNK  16      // samples per SPI record
+
+// --- Tap point ---
+#define WAVE_SRC_OFF      0
+#define WAVE_SRC_RAW      1  // decimated ADC samples, FIR input
+#define WAVE_SRC_FILTERED 2  // FIR output
+#define WAVE_SRC_CURRENT  3  // integrated current
+
+// --- Record flags ---
+#define WAVE_DELTA        0x01  // first sample absolute, then int8 deltas
+#define WAVE_DELTA_ESC    0x80  // delta escape: absolute int16 follows
+
+// --- Power-up mode ---
+#define WAVE_SOURCE_DEFAULT WAVE_SRC_OFF
+#define WAVE_DELTA_DEFAULT  1
+
+void wave_configure(uint8_t source, uint8_t delta);
+
+/* ADC ISR, every sample */
+void wave_push(int16_t raw, int16_t filtered, int16_t current);
+
+/* Main loop: pack every full chunk into an SPI record. Chunks the link
+   cannot take within its budget are dropped, the record sequence numbers
+   show the gap. Flushes the open SPI frame when anything was queued.
+   Returns the chunks queued. */
+uint8_t wave_pump(void);
+
+uint16_t wave_lost(void);   // samples overwritten before the main loop got them
+
+#endif
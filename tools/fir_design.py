@@ -0,0 +1,197 @@
+#!/usr/bin/env python3
+"""FIR profile generator: window-method designs, quantized to Q15.
+
+Reads a profile spec (tools/fir_profiles.txt) and writes src/fir_coeffs.h,
+one straight-line kernel per profile for src/fir.c. Run from the makefile:
+
+    python3 tools/fir_design.py tools/fir_profiles.txt -o src/fir_coeffs.h
+
+Spec lines: name type cutoff_hz taps window rate_hz
+    type     lowpass | highpass | bandpass (cutoff lo-hi, e.g. 40-300)
+    window   rect | hann | hamming | blackman
+Kernels are symmetric (linear phase) and folded into tap pairs, so each
+profile costs ceil(taps / 2) multiplies per sample. Low-pass profiles are
+normalized to exactly unity DC gain, high-pass to unity at Nyquist and
+band-pass at the band centre.
+"""
+
+import argparse
+import math
+import sys
+
+Q15 = 32768
+WINDOWS = ("rect", "hann", "hamming", "blackman")
+
+
+def window(kind, n, taps):
+    if taps == 1 or kind == "rect":
+        return 1.0
+    a = 2 * math.pi * n / (taps - 1)
+    if kind == "hann":
+        return 0.5 - 0.5 * math.cos(a)
+    if kind == "hamming":
+        return 0.54 - 0.46 * math.cos(a)
+    return 0.42 - 0.5 * math.cos(a) + 0.08 * math.cos(2 * a)
+
+
+def sinc_lowpass(fc, taps):
+    """Ideal low-pass impulse response, fc in cycles per sample."""
+    mid = (taps - 1) / 2
+    h = []
+    for n in range(taps):
+        t = n - mid
+        h.append(2 * fc if t == 0 else math.sin(2 * math.pi * fc * t) / (math.pi * t))
+    return h
+
+
+def response(h, f):
+    """Magnitude at f cycles per sample."""
+    re = sum(c * math.cos(2 * math.pi * f * n) for n, c in enumerate(h))
+    im = sum(c * math.sin(2 * math.pi * f * n) for n, c in enumerate(h))
+    return math.hypot(re, im)
+
+
+def design(p):
+    taps, rate = p["taps"], p["rate"]
+    if p["type"] == "bandpass":
+        f1, f2 = (c / rate for c in p["cutoff"])
+        h = [b - a for a, b in zip(sinc_lowpass(f1, taps), sinc_lowpass(f2, taps))]
+        norm_f = (f1 + f2) / 2
+    else:
+        fc = p["cutoff"][0] / rate
+        h = sinc_lowpass(fc, taps)
+        norm_f = 0.0
+        if p["type"] == "highpass":
+            # spectral inversion needs a centre tap
+            h = [-c for c in h]
+            h[(taps - 1) // 2] += 1.0
+            norm_f = 0.5
+
+    h = [c * window(p["window"], n, taps) for n, c in enumerate(h)]
+    g = response(h, norm_f)
+    h = [c / g for c in h]
+
+    q = [int(round(c * Q15)) for c in h]
+    if p["type"] == "lowpass":
+        # put the rounding residue on the centre tap(s): unity DC gain exactly,
+        # so the DC tracker in dsp.c sees the input offset unscaled
+        # (an even kernel sums to twice its half, so its residue is even too)
+        residue = Q15 - sum(q)
+        mid = (taps - 1) // 2
+        if taps % 2:
+            q[mid] += residue
+        else:
+            q[mid] += residue // 2
+            q[mid + 1] += residue // 2
+    for c in q:
+        if not -Q15 <= c < Q15:
+            raise ValueError("%s: coefficient %d does not fit Q15" % (p["name"], c))
+    return q
+
+
+def passband(q, rate):
+    """Edges of the band around the peak gain that is within 3 dB of it, Hz."""
+    steps = 500
+    gains = [response(q, k / (2 * steps)) for k in range(steps + 1)]
+    peak = max(gains)
+    lo = hi = gains.index(peak)
+    while lo > 0 and gains[lo - 1] >= peak / math.sqrt(2):
+        lo -= 1
+    while hi < steps and gains[hi + 1] >= peak / math.sqrt(2):
+        hi += 1
+    return lo / (2 * steps) * rate, hi / (2 * steps) * rate
+
+
+def parse(path):
+    profiles = []
+    with open(path) as f:
+        for lineno, line in enumerate(f, 1):
+            line = line.split("#", 1)[0].strip()
+            if not line:
+                continue
+            fields = line.split()
+            if len(fields) != 6:
+                raise ValueError("%s:%d: expected name type cutoff_hz taps window rate_hz" % (path, lineno))
+            name, kind, cutoff, taps, win, rate = fields
+            p = {
+                "name": name,
+                "type": kind,
+                "cutoff": [float(c) for c in cutoff.split("-")],
+                "taps": int(taps),
+                "window": win,
+                "rate": float(rate),
+            }
+            if kind not in ("lowpass", "highpass", "bandpass"):
+                raise ValueError("%s:%d: unknown type %s" % (path, lineno, kind))
+            if len(p["cutoff"]) != (2 if kind == "bandpass" else 1):
+                raise ValueError("%s:%d: %s takes %s cutoff" % (path, lineno, kind,
+                                 "a lo-hi" if kind == "bandpass" else "one"))
+            if any(not 0 < c < p["rate"] / 2 for c in p["cutoff"]):
+                raise ValueError("%s:%d: cutoff must lie between 0 and rate / 2" % (path, lineno))
+            if win not in WINDOWS:
+                raise ValueError("%s:%d: window is one of %s" % (path, lineno, ", ".join(WINDOWS)))
+            if not 2 <= p["taps"] <= 64 or (kind == "highpass" and p["taps"] % 2 == 0):
+                raise ValueError("%s:%d: 2..64 taps, odd for a high-pass" % (path, lineno))
+            profiles.append(p)
+    if not profiles:
+        raise ValueError("%s: no profiles" % path)
+    return profiles
+
+
+def macro(name, terms):
+    return "#define %s \\\n    %s\n\n" % (name, " \\\n    ".join(terms))
+
+
+def emit(profiles, spec, out):
+    taps_max = max(p["taps"] for p in profiles)
+    w = out.write
+    w("/* Generated by tools/fir_design.py from %s, do not edit:\n" % spec)
+    w("   change the spec and rebuild. */\n")
+    w("#ifndef FIR_COEFFS_H\n#define FIR_COEFFS_H\n\n")
+    w("#define FIR_PROFILE_COUNT %d\n" % len(profiles))
+    w("#define FIR_TAPS_MAX      %d\n\n" % taps_max)
+
+    for i, p in enumerate(profiles):
+        q = p["q15"]
+        taps = p["taps"]
+        upper = p["name"].upper()
+        cutoff = "-".join("%g" % c for c in p["cutoff"])
+        w("/* %d %s: %s %s Hz at %g Hz, %d taps, %s window; -3 dB passband %.0f-%.0f Hz */\n"
+          % ((i, p["name"], p["type"], cutoff, p["rate"], taps, p["window"]) + passband(q, p["rate"])))
+        w("#define FIR_PROFILE_%s %d\n" % (upper, i))
+        w("#define FIR_%s_TAPS %d\n" % (upper, taps))
+        w("#define FIR_%s_DC_GAIN %d\n" % (upper, max(0, sum(q))))
+        # zero taps cost nothing
+        terms = ["FIR_PAIR(%d, %d, %d)" % (k, taps - 1 - k, q[k]) for k in range(taps // 2) if q[k]]
+        if taps % 2:
+            terms.append("FIR_CENTER(%d, %d)" % (taps // 2, q[taps // 2]))
+        w(macro("FIR_%s_KERNEL" % upper, terms))
+
+    w("/* X(NAME, name) for every profile, in index order */\n")
+    w(macro("FIR_PROFILES(X)", ["X(%s, %s)" % (p["name"].upper(), p["name"]) for p in profiles]))
+    w("#endif\n")
+
+
+def main():
+    ap = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    ap.add_argument("spec")
+    ap.add_argument("-o", "--output", help="header to write, stdout if omitted")
+    args = ap.parse_args()
+
+    try:
+        profiles = parse(args.spec)
+        for p in profiles:
+            p["q15"] = design(p)
+    except ValueError as e:
+        sys.exit("fir_design: %s" % e)
+
+    if args.output:
+        # write only once the design succeeded, so make never sees half a header
+        with open(args.output, "w") as out:
+            emit(profiles, args.spec, out)
+    else:
+        emit(profiles, args.spec, sys.stdout)
+
+
+if __name__ == "__main__":
+    main()